@@ -0,0 +1,42 @@
+import hashlib
+import os
+import sys
+
+source_dir = sys.argv[1]
+code_gen_dir = sys.argv[2]
+
+# Everything that decides how schemas are compiled, saved caches are only loaded by a build of the same sources
+source_dirs = ['.', 'protocol_je', 'protocol_be', 'protocols', 'codegen_script', 'strings']
+source_extensions = ('.c', '.h', '.py', '.json')
+
+
+def get_file_list(path):
+    for root, dirs, files in os.walk(path):
+        return sorted(file for file in files if file.endswith(source_extensions))
+    return []
+
+
+build_hash = hashlib.sha1()
+for directory in source_dirs:
+    for file in get_file_list(os.path.join(source_dir, directory)):
+        with open(os.path.join(source_dir, directory, file), 'rb') as fi:
+            build_hash.update(f'{directory}/{file}\n'.encode('utf-8'))
+            build_hash.update(fi.read().replace(b'\r\n', b'\n'))  # Same id for CRLF checkouts
+
+with open(code_gen_dir + '/buildId.h', 'w') as f:
+    f.write('\n'.join([
+        '// Auto generate codes, DO NOT MODIFY THIS FILE',
+        '#pragma once',
+        'extern const char BUILD_ID[];',
+        ''
+    ]))
+
+with open(code_gen_dir + '/buildId.c', 'w') as f:
+    f.write('\n'.join([
+        '// Auto generate codes, DO NOT MODIFY THIS FILE',
+        '#include "buildId.h"',
+        f'const char BUILD_ID[] = "{build_hash.hexdigest()}";',
+        ''
+    ]))
+
+print(f'Build id: {build_hash.hexdigest()}')
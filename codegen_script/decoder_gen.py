@@ -0,0 +1,166 @@
+import json
+import os
+import re
+import sys
+
+data_dir = sys.argv[1]
+code_gen_dir = sys.argv[2]
+versions = [v for v in re.split('[;,]', sys.argv[3] if len(sys.argv) > 3 else '') if v != '']
+
+# Keep in sync with the ADD_NATIVE list in protocols/protocol_schema.c
+native_functions = {
+    'varint': 'var_int',
+    'optvarint': 'var_int',
+    'varlong': 'var_long',
+    'string': 'string',
+    'u8': 'u8',
+    'u16': 'u16',
+    'u32': 'u32',
+    'u64': 'u64',
+    'i8': 'i8',
+    'i16': 'i16',
+    'i32': 'i32',
+    'i64': 'i64',
+    'bool': 'boolean',
+    'f32': 'f32',
+    'f64': 'f64',
+    'UUID': 'uuid',
+    'restBuffer': 'rest_buffer',
+    'void': 'void',
+    'optionalNbt': 'optional_nbt',
+}
+# Natives whose decoder depends on protocol settings, called through the compiled field
+native_dynamic = {'nbt'}
+
+
+def get_file_list(path):
+    for root, dirs, files in os.walk(path):
+        return dirs
+    return []
+
+
+def latest_version():
+    with open(data_dir + '/protocolVersions.json', 'r') as file:
+        data_versions = {v['minecraftVersion']: v['dataVersion'] for v in json.load(file)
+                         if v['usesNetty'] and 'dataVersion' in v}
+    available = [v for v in get_file_list(data_dir)
+                 if v in data_versions and os.path.exists(f'{data_dir}/{v}/protocol.json')]
+    return [max(available, key=lambda v: data_versions[v])] if available else []
+
+
+def classify(data, types, depth=0):
+    # Mirrors parse_protocol(): ('native', function), ('container', children) or ('dynamic',) for fields
+    # decoded through their compiled make_tree, None if the interpreter could not compile it either
+    if depth > 64:
+        return None
+    if isinstance(data, str):
+        if data in native_functions:
+            return 'native', 'make_tree_' + native_functions[data]
+        if data in native_dynamic:
+            return 'dynamic',
+        if data in types:
+            return classify(types[data], types, depth + 1)
+        return None
+    if not isinstance(data, list) or len(data) != 2:
+        return None
+    if data[0] != 'container':
+        return 'dynamic',
+    children = []
+    for child in data[1]:
+        sub = classify(child.get('type'), types, depth + 1)
+        if sub is None:
+            return None
+        children.append((child.get('name', '[unnamed]'), sub))
+    return 'container', children
+
+
+class Generator:
+    def __init__(self):
+        self.functions = []
+        self.decoders = []
+
+    def emit_container(self, name, children, top):
+        nested = {}
+        for index, (_, child) in enumerate(children):
+            if child[0] == 'container':
+                nested[index] = self.emit_container(f'{name}_{index}', child[1], False)
+
+        check = [f'    if (field == NULL || field->make_tree != make_tree_je_container ||\n'
+                 f'        field->container.size != {len(children)} || field->container.on_top != {str(top).lower()})\n'
+                 f'        return false;\n',
+                 '    protocol_field *children = field->container.children;\n'
+                 if any(child[0] != 'dynamic' for _, child in children) else '']
+        decode = ['    protocol_field *children = field->container.children;\n'] if children else []
+        decode.append('    guint start = offset, length;\n' if children else '    guint start = offset;\n')
+        if not top:
+            decode.append('    record_push(recorder);\n'
+                          '    if (tree)\n'
+                          '        tree = proto_tree_add_subtree(tree, tvb, offset, remaining, ett_sub_je, NULL,\n'
+                          '                                      field->display_name);\n')
+        for index, (child_name, child) in enumerate(children):
+            if child[0] == 'native':
+                function = child[1]
+                check.append(f'    if (children[{index}]->make_tree != {function})\n        return false;\n')
+            elif child[0] == 'container':
+                function = f'make_tree_{nested[index]}'
+                check.append(f'    if (!check_{nested[index]}(children[{index}]))\n        return false;\n')
+            else:
+                function = f'children[{index}]->make_tree'
+            macro = 'AOT_ANONYMOUS_FIELD' if child_name == '[unnamed]' and not top else 'AOT_FIELD'
+            decode.append(f'    {macro}({index}, {function})\n')
+        check.append('    return true;\n')
+        if not top:
+            decode.append('    proto_item_set_len(proto_tree_get_parent(tree), offset - start);\n'
+                          '    record_pop(recorder);\n')
+        decode.append('    return offset - start;\n')
+
+        self.functions.append(f'static bool check_{name}(protocol_field field) {{\n' + ''.join(check) + '}\n\n' +
+                              f'static FIELD_MAKE_TREE({name}) {{\n' + ''.join(decode) + '}\n')
+        return name
+
+    def emit_version(self, version):
+        with open(f'{data_dir}/{version}/protocol.json', 'r') as file:
+            protocol = json.load(file)
+        types = protocol['types']
+        version_id = re.sub('[^0-9a-zA-Z]', '_', version)
+        for state in ['login', 'configuration', 'play']:
+            if state not in protocol:
+                continue
+            for direction, side in [('toClient', 'c'), ('toServer', 's')]:
+                packets = protocol[state][direction]['types']
+                for packet_name, definition in packets.items():
+                    if not packet_name.startswith('packet_') or packet_name == 'packet':
+                        continue
+                    packet = packet_name[len('packet_'):]
+                    shape = classify(definition, types)
+                    if shape is None or shape[0] != 'container':
+                        continue
+                    name = f'aot_{version_id}_{state}_{side}_{re.sub("[^0-9a-zA-Z]", "_", packet)}'
+                    self.emit_container(name, shape[1], True)
+                    self.decoders.append((f'{version}/{state}/{side}/{packet}', name))
+
+
+if len(versions) == 0:
+    versions = latest_version()
+
+generator = Generator()
+for v in versions:
+    if not os.path.exists(f'{data_dir}/{v}/protocol.json'):
+        print(f'Skip {v}: no protocol data')
+        continue
+    generator.emit_version(v)
+
+with open(code_gen_dir + '/aotDecoders.c', 'w') as f:
+    f.write("""// Auto generate codes, DO NOT MODIFY THIS FILE
+#include "protocols/aot_decoder.h"
+
+""")
+    f.write('\n'.join(generator.functions))
+    f.write('\nconst aot_decoder AOT_DECODERS[] = {\n')
+    for key, name in generator.decoders:
+        f.write(f'    {{"{key}", check_{name}, make_tree_{name}}},\n')
+    f.write('    {NULL, NULL, NULL}\n')
+    f.write('};\n')
+
+print(f'Versions: {", ".join(versions)}')
+print(f'Generated decoders: {len(generator.decoders)}')
@@ -1,3 +1,4 @@
+import hashlib
 import json
 import os
 import sys
@@ -5,6 +6,21 @@ import sys
 data_dir = sys.argv[1]
 code_gen_dir = sys.argv[2]
 
+# Node types, keep in sync with protocols/binary_schema.h
+SCHEMA_NULL = 0
+SCHEMA_FALSE = 1
+SCHEMA_TRUE = 2
+SCHEMA_NUMBER = 3
+SCHEMA_STRING = 4
+SCHEMA_ARRAY = 5
+SCHEMA_OBJECT = 6
+SCHEMA_NO_KEY = 0xFFFFFFFF
+
+string_pool = bytearray()
+string_offsets = {}
+nodes = []
+blocks = {}
+
 
 def get_file_list(path):
     for root, dirs, files in os.walk(path):
@@ -12,46 +28,89 @@ def get_file_list(path):
     return []
 
 
+def intern_string(value):
+    if value not in string_offsets:
+        string_offsets[value] = len(string_pool)
+        string_pool.extend(value.encode('utf-8'))
+        string_pool.append(0)
+    return string_offsets[value]
+
+
+def describe(value):
+    # Returns (type, value, size) of a node; children are emitted as a contiguous block shared by equal contents
+    if value is None:
+        return SCHEMA_NULL, 0, 0
+    if isinstance(value, bool):
+        return (SCHEMA_TRUE if value else SCHEMA_FALSE), 0, 0
+    if isinstance(value, (int, float)):
+        if int(value) != value or not -0x80000000 <= value <= 0x7FFFFFFF:
+            raise ValueError(f'Unsupported number in schema: {value}')
+        return SCHEMA_NUMBER, int(value), 0
+    if isinstance(value, str):
+        return SCHEMA_STRING, intern_string(value), 0
+    if isinstance(value, list):
+        children = tuple((SCHEMA_NO_KEY,) + describe(item) for item in value)
+        node_type = SCHEMA_ARRAY
+    else:
+        children = tuple((intern_string(key),) + describe(item) for key, item in value.items())
+        node_type = SCHEMA_OBJECT
+    if len(children) >= 1 << 29:
+        raise ValueError('Too many children in schema node')
+    if children not in blocks:
+        blocks[children] = len(nodes)
+        nodes.extend(children)
+    return node_type, blocks[children], len(children)
+
+
+def add_root(value):
+    node_type, node_value, size = describe(value)
+    nodes.append((SCHEMA_NO_KEY, node_type, node_value, size))
+    return len(nodes) - 1
+
+
 def get_data(root):
     with open(root + '/protocolVersions.json', 'r') as file:
-        data_json = json.load(file)
-        protocol_version_data = json.dumps(data_json).replace('"', '\\"')
+        protocol_version_root = add_root(json.load(file))
 
     available_versions = get_file_list(root)
     versions_data = {}
     for v in available_versions:
         if os.path.exists(f'{root}/{v}/protocol.json'):
             with open(f'{root}/{v}/protocol.json', 'r') as file:
-                data_json = json.load(file)
-                versions_data[v] = json.dumps(data_json).replace('"', '\\"')
+                versions_data[v] = add_root(json.load(file))
 
-    return protocol_version_data, versions_data
+    return protocol_version_root, versions_data
 
 
-je_protocol_version_data, je_versions_data = get_data(data_dir + '/java')
-be_protocol_version_data, be_versions_data = get_data(data_dir + '/bedrock')
+je_protocol_version_root, je_versions_data = get_data(data_dir + '/java')
+be_protocol_version_root, be_versions_data = get_data(data_dir + '/bedrock')
 
 with open(code_gen_dir + '/protocolVersions.h', 'w') as f:
     f.write("""// Auto generate codes, DO NOT MODIFY THIS FILE
 #pragma once
-extern const char* PROTOCOL_VERSIONS_JE;
-extern const char* PROTOCOL_VERSIONS_BE;
+extern const unsigned int PROTOCOL_VERSIONS_JE;
+extern const unsigned int PROTOCOL_VERSIONS_BE;
 """)
 
 with open(code_gen_dir + '/protocolVersions.c', 'w') as f:
     f.write("""// Auto generate codes, DO NOT MODIFY THIS FILE
 #include "protocolVersions.h"
 """)
-    f.write(f'const char* PROTOCOL_VERSIONS_JE = "{je_protocol_version_data}";\n')
-    f.write(f'const char* PROTOCOL_VERSIONS_BE = "{be_protocol_version_data}";\n')
+    f.write(f'const unsigned int PROTOCOL_VERSIONS_JE = {je_protocol_version_root};\n')
+    f.write(f'const unsigned int PROTOCOL_VERSIONS_BE = {be_protocol_version_root};\n')
 
 with open(code_gen_dir + '/protocolSchemas.h', 'w') as f:
     f.write("""// Auto generate codes, DO NOT MODIFY THIS FILE
 #pragma once
+#include "protocols/binary_schema.h"
+extern const char SCHEMA_STRINGS[];
+extern const schema_node_t SCHEMA_NODES[];
+extern const unsigned int SCHEMA_NODE_COUNT;
 extern const int JE_PROTOCOL_SIZE;
-extern const char *JE_PROTOCOLS[];
+extern const schema_document JE_PROTOCOLS[];
 extern const int BE_PROTOCOL_SIZE;
-extern const char *BE_PROTOCOLS[];
+extern const schema_document BE_PROTOCOLS[];
+extern const char SCHEMA_HASH[];
 """)
 
 with open(code_gen_dir + '/protocolSchemas.c', 'w') as f:
@@ -59,17 +118,36 @@ with open(code_gen_dir + '/protocolSchemas.c', 'w') as f:
 #include "protocolSchemas.h"
 """)
 
+    f.write('const char SCHEMA_STRINGS[] = {')
+    for i in range(0, len(string_pool), 64):
+        f.write('\n    ' + ','.join(str(byte) for byte in string_pool[i:i + 64]) + ',')
+    f.write('\n};\n')
+
+    f.write('const schema_node_t SCHEMA_NODES[] = {\n')
+    for key, node_type, node_value, size in nodes:
+        f.write(f'    {{{(size << 3) | node_type}u, {key}u, {node_value}}},\n')
+    f.write('};\n')
+    f.write(f'const unsigned int SCHEMA_NODE_COUNT = {len(nodes)};\n')
+
     f.write(f'const int JE_PROTOCOL_SIZE = {len(je_versions_data)};\n')
-    f.write('const char *JE_PROTOCOLS[] = {\n')
+    f.write('const schema_document JE_PROTOCOLS[] = {\n')
     for version in je_versions_data:
-        f.write(f'    "{version}", "{je_versions_data[version]}",\n')
+        f.write(f'    {{"{version}", {je_versions_data[version]}}},\n')
+    f.write('    {0, 0}\n')
     f.write('};\n')
 
+    schema_hash = hashlib.sha1(bytes(string_pool))
+    for node in nodes:
+        schema_hash.update(repr(node).encode('utf-8'))
+    f.write(f'const char SCHEMA_HASH[] = "{schema_hash.hexdigest()}";\n')
+
     f.write(f'const int BE_PROTOCOL_SIZE = {len(be_versions_data)};\n')
-    f.write('const char *BE_PROTOCOLS[] = {\n')
+    f.write('const schema_document BE_PROTOCOLS[] = {\n')
     for version in be_versions_data:
-        f.write(f'    "{version}", "{be_versions_data[version]}",\n')
+        f.write(f'    {{"{version}", {be_versions_data[version]}}},\n')
+    f.write('    {0, 0}\n')
     f.write('};\n')
 
 print(f'Java version count: {len(je_versions_data)}')
 print(f'Bedrock version count: {len(be_versions_data)}')
+print(f'Schema nodes: {len(nodes)}, string pool: {len(string_pool)} bytes')
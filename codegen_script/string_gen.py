@@ -1,3 +1,4 @@
+import hashlib
 import json
 import sys
 
@@ -12,11 +13,10 @@ bitmask_collection_defines = []
 
 hf_lines = []
 complex_hf = {}
-add_hf_lines = []
 bitmask_collection_lines = []
-cp_lines = []
 packet_client_lines = []
 packet_server_lines = []
+name_trie_keys = {}
 
 mapping = {
     'i32': 'INT32',
@@ -91,6 +91,23 @@ def add_default_fields():
     hf_defines.append(f'hf_array_length_{edition}')
     hf_lines.append(
         f'\t\tDEFINE_HF(hf_array_length_{edition}, "Array Length", "mc{edition}.array_length", UINT32, DEC)')
+    hf_defines.append(f'hf_array_data_{edition}')
+    hf_lines.append(
+        f'\t\tDEFINE_HF(hf_array_data_{edition}, "Array Data", "mc{edition}.array_data", BYTES, NONE)')
+    hf_defines.append(f'hf_nbt_tag_{edition}')
+    hf_lines.append(f'\t\tDEFINE_HF(hf_nbt_tag_{edition}, "NBT Tag", "mc{edition}.nbt_tag", STRING, NONE)')
+    hf_defines.append(f'hf_non_air_blocks_{edition}')
+    hf_lines.append(
+        f'\t\tDEFINE_HF(hf_non_air_blocks_{edition}, "Non-Air Blocks", "mc{edition}.non_air_blocks", INT16, DEC)')
+    hf_defines.append(f'hf_bits_per_entry_{edition}')
+    hf_lines.append(
+        f'\t\tDEFINE_HF(hf_bits_per_entry_{edition}, "Bits per Entry", "mc{edition}.bits_per_entry", UINT8, DEC)')
+    hf_defines.append(f'hf_palette_entry_{edition}')
+    hf_lines.append(
+        f'\t\tDEFINE_HF(hf_palette_entry_{edition}, "Palette Entry", "mc{edition}.palette_entry", UINT32, DEC)')
+    hf_defines.append(f'hf_paletted_entry_{edition}')
+    hf_lines.append(
+        f'\t\tDEFINE_HF(hf_paletted_entry_{edition}, "Entry", "mc{edition}.paletted_entry", UINT32, DEC)')
 
 
 def make_simple_hf(key, value, type_name):
@@ -135,9 +152,9 @@ def read_data():
         hf_mappings_json = data['mappings']
         for key, value in hf_mappings_json.items():
             if value in complex_hf:
-                add_hf_lines.append(f'\tADD_COMPLEX_HF("{key}", "{value}")')
+                name_trie_keys.setdefault(key, {})['complex'] = value
             else:
-                add_hf_lines.append(f'\tADD_HF("{key}", hf_{value})')
+                name_trie_keys.setdefault(key, {})['hf'] = value
 
         bitmask_collection_json = data['bitmask_collection']
         bitmask_count = 0
@@ -163,7 +180,7 @@ def read_data():
 
         cp_lines_json = data['component_names']
         for key, value in cp_lines_json.items():
-            cp_lines.append(f'\tADD_CP("{key}", "{value}")')
+            name_trie_keys.setdefault(key, {})['component'] = value
 
         packet_name_json = data['packet_names']
         for key, value in packet_name_json['toClient'].items():
@@ -172,6 +189,31 @@ def read_data():
             packet_server_lines.append(f'\tDEFINE_NAME_SERVER({key}, {value})')
 
 
+def make_name_trie():
+    # Keys are reversed so a path is matched from its end, every suffix is visited in a single walk
+    root = {}
+    for key, value in name_trie_keys.items():
+        node = root
+        for c in reversed(key):
+            node = node.setdefault(c, {})
+        node[None] = value
+    nodes = [(None, root)]
+    lines = []
+    index = 0
+    while index < len(nodes):
+        c, node = nodes[index]
+        children = sorted((k, v) for k, v in node.items() if k is not None)
+        value = node.get(None, {})
+        hf = f'&hf_{value["hf"]}' if 'hf' in value else 'NULL'
+        complex_name = f'"{value["complex"]}"' if 'complex' in value else 'NULL'
+        component = f'"{value["component"]}"' if 'component' in value else 'NULL'
+        char = "'\\0'" if c is None else repr(c) if c != "'" else "'\\''"
+        lines.append(f'\t{{{char}, {len(children)}, {len(nodes) if children else 0}, {hf}, {complex_name}, {component}}}')
+        nodes.extend(children)
+        index += 1
+    return lines
+
+
 def write_data():
     with open(code_gen_header, 'w', encoding='utf-8') as f:
         f.write('\n'.join([
@@ -183,6 +225,7 @@ def write_data():
             f'int get_string_{edition}(const char *name, const char *type);',
             f'extern wmem_map_t *protocol_name_map_client_{edition};',
             f'extern wmem_map_t *protocol_name_map_server_{edition};',
+            f'extern const char HF_HASH_{edition}[];',
             ''
         ]))
     with open(code_gen_file, 'w', encoding='utf-8') as f:
@@ -192,18 +235,12 @@ def write_data():
             f'int ett_mc{edition} = -1;',
             f'int ett_{edition}_proto = -1;',
             f'int ett_sub_{edition} = -1;',
-            f'wmem_map_t *name_hf_map_{edition} = NULL;',
-            f'wmem_map_t *complex_name_map_{edition} = NULL;',
             f'wmem_map_t *complex_hf_map_{edition} = NULL;',
             f'wmem_map_t *unknown_hf_map_{edition} = NULL;',
             f'wmem_map_t *bitmask_hf_map_{edition} = NULL;',
-            f'wmem_map_t *component_map_{edition} = NULL;',
             f'wmem_map_t *hf_mapping_{edition} = NULL;',
             f'wmem_map_t *protocol_name_map_client_{edition} = NULL;',
             f'wmem_map_t *protocol_name_map_server_{edition} = NULL;',
-            f'#define ADD_HF(name, hf_index) wmem_map_insert(name_hf_map_{edition}, name, GINT_TO_POINTER(hf_index));',
-            f'#define ADD_COMPLEX_HF(name, map) wmem_map_insert(complex_name_map_{edition}, name, map);',
-            f'#define ADD_CP(name, display_name) wmem_map_insert(component_map_{edition}, name, display_name);',
             f'#define ADD_BITMASK(name, link) wmem_map_insert(bitmask_hf_map_{edition}, name, link);',
             f'#define ADD_HF_MAPPING(name, link) wmem_map_insert(hf_mapping_{edition}, name, link);',
             f'#define DEFINE_NAME_CLIENT(name, desc) wmem_map_insert(protocol_name_map_client_{edition}, #name, #desc);',
@@ -220,15 +257,20 @@ def write_data():
         # write value string
         f.write('\n'.join(value_string_lines))
         f.write('\n')
+        # write hash of the hf table, saved schemas refer to hf by abbreviation
+        hf_hash = hashlib.sha1('\n'.join(hf_lines).encode('utf-8'))
+        f.write(f'const char HF_HASH_{edition}[] = "{hf_hash.hexdigest()}";\n')
+        # write name trie
+        trie_lines = make_name_trie()
+        f.write(f'const name_trie_node name_trie_{edition}[] = {{\n')
+        f.write(',\n'.join(trie_lines))
+        f.write('\n};\n')
         # main
         f.write('\n'.join([
             f'void register_string_{edition}() {{',
-            f'\tname_hf_map_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
-            f'\tcomplex_name_map_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
             f'\tcomplex_hf_map_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
             f'\tunknown_hf_map_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
             f'\tbitmask_hf_map_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
-            f'\tcomponent_map_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
             f'\thf_mapping_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
             f'\tprotocol_name_map_client_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
             f'\tprotocol_name_map_server_{edition} = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);',
@@ -258,9 +300,6 @@ def write_data():
         # mapping
         for hf_define in hf_defines:
             f.write(f'\tADD_HF_MAPPING("{hf_define}", &{hf_define})\n')
-        # add hf
-        f.write('\n'.join(add_hf_lines))
-        f.write('\n')
         # add complex hf
         cpx_count = 0
         for key in complex_hf:
@@ -272,9 +311,6 @@ def write_data():
         # bitmask collection
         f.write('\n'.join(bitmask_collection_lines))
         f.write('\n')
-        # add cp
-        f.write('\n'.join(cp_lines))
-        f.write('\n')
         # add packet names
         f.write('\n'.join(packet_client_lines))
         f.write('\n')
@@ -303,9 +339,8 @@ def write_data():
 read_data()
 write_data()
 print(f'Generate {len(hf_defines)} hf defines.')
-print(f'Generate {len(add_hf_lines)} hf lines.')
+print(f'Generate {len(name_trie_keys)} hf name index keys.')
 print(f'Generate {len(bitmask_collection_lines)} bitmask collection lines.')
-print(f'Generate {len(cp_lines)} component lines.')
 print(f'Generate {len(value_string_lines)} value string lines.')
 print(f'Generate {len(packet_client_lines)} packet client lines.')
 print(f'Generate {len(packet_server_lines)} packet server lines.')
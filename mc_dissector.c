@@ -10,7 +10,7 @@
 #include "protocol_je/je_dissect.h"
 #include "protocol_be/be_dissect.h"
 
-WS_DLL_PUBLIC_DEF _U_ const gchar plugin_version[] = "0.0.0";
+WS_DLL_PUBLIC_DEF _U_ const gchar plugin_version[] = MC_DISSECTOR_VERSION;
 WS_DLL_PUBLIC_DEF _U_ const int plugin_want_major = WIRESHARK_VERSION_MAJOR;
 WS_DLL_PUBLIC_DEF _U_ const int plugin_want_minor = WIRESHARK_VERSION_MINOR;
 
@@ -19,6 +19,10 @@ WS_DLL_PUBLIC _U_ void plugin_register();
 int proto_mcje = -1;
 int proto_mcbe = -1;
 
+#ifdef DEBUG
+gint decode_heap_allocations = 0;
+#endif
+
 _U_ void plugin_register() {
     if (proto_mcje == -1) {
         static proto_plugin plugMCJE;
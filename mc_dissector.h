@@ -7,6 +7,8 @@
 
 #include <epan/tfs.h>
 
+#define MC_DISSECTOR_VERSION "0.0.0"
+
 #define MCJE_PORT 25565
 #define MCBE_PORT 19132
 #define MCJE_NAME "Minecraft Java Edition"
@@ -22,12 +24,34 @@
 #define DEFINE_HF_BITMASK_VAL(name, desc, key, type, dis, bitmask, val) {&name, {desc, key, FT_##type, BASE_##dis, VALS(val), bitmask, NULL, HFILL}},
 #define DEFINE_HF_BITMASK_TF(name, desc, key, bitmask) {&name, {desc, key, FT_BOOLEAN, 8, TFS(tf_string), bitmask, NULL, HFILL}},
 
+// Trie over the reversed keys of hf mappings and component names, generated by string_gen.py.
+// Node 0 is the root, children of a node are contiguous and sorted by character.
+typedef struct {
+    gchar c;
+    guint16 child_count;
+    guint32 first_child;
+    int *hf_index;
+    const gchar *complex_name;
+    const gchar *component_name;
+} name_trie_node;
+
 #if Windows == SYSTEM_NAME && defined(DEBUG)
+#include <wsutil/wslog.h>
 #define WS_LOG(format, ...) ws_log("", LOG_LEVEL_CRITICAL, format, ##__VA_ARGS__)
 #else
 #define WS_LOG(format, ...)
 #endif
 
+#ifdef DEBUG
+// Allocations outside wmem_packet_scope() made while a packet is decoded, steady-state dissection must leave it
+// unchanged. With MC_DISSECTOR_CHECK_ALLOCATIONS a packet decoded again with the same kind of tree in the same capture
+// asserts that it didn't allocate.
+extern gint decode_heap_allocations;
+#define COUNT_DECODE_ALLOCATION() g_atomic_int_add(&decode_heap_allocations, 1)
+#else
+#define COUNT_DECODE_ALLOCATION()
+#endif
+
 extern int proto_mcje;
 extern int proto_mcbe;
 
@@ -19,14 +19,13 @@ int hf_unknown_string_be = -1;
 int hf_unknown_boolean_be = -1;
 int hf_unknown_uuid_be = -1;
 int hf_array_length_be = -1;
+int hf_array_data_be = -1;
 
 int ett_sub_be = -1;
-wmem_map_t *name_hf_map_be = NULL;
-wmem_map_t *complex_name_map_be = NULL;
 wmem_map_t *complex_hf_map_be = NULL;
 wmem_map_t *unknown_hf_map_be = NULL;
 wmem_map_t *bitmask_hf_map_be = NULL;
-wmem_map_t *component_map_be = NULL;
+const name_trie_node name_trie_be[] = {{'\0', 0, 0, NULL, NULL, NULL}};
 
 void proto_register_mcbe() {
     proto_mcbe = proto_register_protocol(MCBE_NAME, MCBE_SHORT_NAME, MCBE_FILTER);
@@ -6,16 +6,15 @@
 #define MC_DISSECTOR_BE_DISSECT_H
 
 #include <epan/packet.h>
+#include "mc_dissector.h"
 
 extern dissector_handle_t mcbe_boot_handle, mcbe_handle, ignore_be_handle;
 
 extern int ett_sub_be;
-extern wmem_map_t *name_hf_map_be;
-extern wmem_map_t *complex_name_map_be;
 extern wmem_map_t *complex_hf_map_be;
 extern wmem_map_t *unknown_hf_map_be;
 extern wmem_map_t *bitmask_hf_map_be;
-extern wmem_map_t *component_map_be;
+extern const name_trie_node name_trie_be[];
 
 extern int hf_unknown_int_be;
 extern int hf_unknown_uint_be;
@@ -28,6 +27,7 @@ extern int hf_unknown_string_be;
 extern int hf_unknown_boolean_be;
 extern int hf_unknown_uuid_be;
 extern int hf_array_length_be;
+extern int hf_array_data_be;
 
 void proto_register_mcbe();
 
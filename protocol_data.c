@@ -6,7 +6,53 @@
 
 char *STATE_NAME[] = {"Handshake", "Play", "Server List Ping", "Login", "Configuration", "Invalid"};
 
+// With GCC or Clang a VarInt is read from one little-endian word: the first byte without the top bit ends it, and the
+// 7 bit groups before it are packed with PEXT or three shift and mask steps. Shorter buffers are read byte by byte.
+#if defined(__GNUC__)
+#define VAR_NUM_WORD_AT_A_TIME
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif // __BMI2__
+#endif // __GNUC__
+
+#define VAR_NUM_STOP_BITS G_GUINT64_CONSTANT(0x8080808080808080)
+#define VAR_NUM_PAYLOAD_BITS G_GUINT64_CONSTANT(0x7F7F7F7F7F7F7F7F)
+
+#ifdef VAR_NUM_WORD_AT_A_TIME
+static inline guint64 load_var_num_word(const guint8 *data) {
+    guint64 word;
+    memcpy(&word, data, sizeof(word));
+    return GUINT64_FROM_LE(word);
+}
+
+// Value of the first length bytes of the word
+static inline guint64 pack_var_num(guint64 word, guint length) {
+    if (length < 8)
+        word &= (G_GUINT64_CONSTANT(1) << (length * 8)) - 1;
+#ifdef __BMI2__
+    return _pext_u64(word, VAR_NUM_PAYLOAD_BITS);
+#else
+    word &= VAR_NUM_PAYLOAD_BITS;
+    word = ((word & G_GUINT64_CONSTANT(0x7F007F007F007F00)) >> 1) | (word & G_GUINT64_CONSTANT(0x007F007F007F007F));
+    word = ((word & G_GUINT64_CONSTANT(0x3FFF00003FFF0000)) >> 2) | (word & G_GUINT64_CONSTANT(0x00003FFF00003FFF));
+    word = ((word & G_GUINT64_CONSTANT(0x0FFFFFFF00000000)) >> 4) | (word & G_GUINT64_CONSTANT(0x000000000FFFFFFF));
+    return word;
+#endif // __BMI2__
+}
+#endif // VAR_NUM_WORD_AT_A_TIME
+
 gint read_var_int(const guint8 *data, guint max_length, guint *result) {
+#ifdef VAR_NUM_WORD_AT_A_TIME
+    if (max_length >= 8) {
+        guint64 word = load_var_num_word(data);
+        guint64 stops = ~word & VAR_NUM_STOP_BITS;
+        guint length = stops == 0 ? 0 : __builtin_ctzll(stops) / 8 + 1;
+        if (length == 0 || length > 5)
+            return INVALID_DATA;
+        *result = (guint) pack_var_num(word, length);
+        return (gint) length;
+    }
+#endif // VAR_NUM_WORD_AT_A_TIME
     gint p = 0;
     *result = 0;
     guint8 read;
@@ -14,7 +60,7 @@ gint read_var_int(const guint8 *data, guint max_length, guint *result) {
         if (p == 5 || p >= max_length)
             return INVALID_DATA;
         read = data[p];
-        *result |= (read & 0x7F) << (7 * p++);
+        *result |= (guint) (read & 0x7F) << (7 * p++);
     } while ((read & 0x80) != 0);
     return p;
 }
@@ -22,16 +68,63 @@ gint read_var_int(const guint8 *data, guint max_length, guint *result) {
 gint read_var_long(const guint8 *data, guint max_length, guint64 *result) {
     gint p = 0;
     *result = 0;
+#ifdef VAR_NUM_WORD_AT_A_TIME
+    if (max_length >= 8) {
+        guint64 word = load_var_num_word(data);
+        guint64 stops = ~word & VAR_NUM_STOP_BITS;
+        if (stops != 0) {
+            guint length = __builtin_ctzll(stops) / 8 + 1;
+            *result = pack_var_num(word, length);
+            return (gint) length;
+        }
+        // Only the 9th and 10th bytes are left
+        *result = pack_var_num(word, 8);
+        p = 8;
+    }
+#endif // VAR_NUM_WORD_AT_A_TIME
     guint8 read;
     do {
         if (p == 10 || p >= max_length)
             return INVALID_DATA;
         read = data[p];
-        *result |= (read & 0x7F) << (7 * p++);
+        *result |= (guint64) (read & 0x7F) << (7 * p++);
     } while ((read & 0x80) != 0);
     return p;
 }
 
+gint skip_var_ints(const guint8 *data, guint max_length, guint count) {
+    guint p = 0;
+#ifdef VAR_NUM_WORD_AT_A_TIME
+    // Whole words are skipped while every VarInt they end is wanted, checking that none is longer than 5 bytes
+    guint run = 0; // bytes of the VarInt not ended yet
+    while (count > 0 && max_length - p >= 8) {
+        guint64 word = load_var_num_word(data + p);
+        guint64 stops = ~word & VAR_NUM_STOP_BITS;
+        if (stops == 0)
+            return INVALID_DATA;
+        guint ended = __builtin_popcountll(stops);
+        if (ended >= count)
+            break;
+        guint64 continues = word & VAR_NUM_STOP_BITS;
+        if (run + __builtin_ctzll(stops) / 8 >= 5 ||
+            (continues & continues >> 8 & continues >> 16 & continues >> 24 & continues >> 32) != 0)
+            return INVALID_DATA;
+        run = __builtin_clzll(stops) / 8;
+        count -= ended;
+        p += 8;
+    }
+    p -= run;
+#endif // VAR_NUM_WORD_AT_A_TIME
+    for (; count > 0; count--) {
+        guint value;
+        gint length = read_var_int(data + p, max_length - p, &value);
+        if (is_invalid(length))
+            return INVALID_DATA;
+        p += length;
+    }
+    return (gint) p;
+}
+
 gint read_ushort(const guint8 *data, guint16 *result) {
     *result = (data[0] << 8) | data[1];
     return 2;
@@ -44,10 +137,10 @@ gint read_ulong(const guint8 *data, guint64 *result) {
     return 8;
 }
 
-gint read_buffer(const guint8 *data, guint8 **result) {
+gint read_buffer(const guint8 *data, guint max_length, guint8 **result) {
     guint length;
-    gint read = read_var_int(data, 5, &length);
-    if (is_invalid(read))
+    gint read = read_var_int(data, max_length, &length);
+    if (is_invalid(read) || length > max_length - read)
         return INVALID_DATA;
     *result = wmem_alloc(wmem_packet_scope(), length + 1);
     memcpy(*result, data + read, length);
@@ -5,6 +5,7 @@
 #ifndef MC_DISSECTOR_PROTOCOL_DATA_H
 #define MC_DISSECTOR_PROTOCOL_DATA_H
 
+#include <string.h>
 #include <epan/proto.h>
 #include <gcrypt.h>
 #include "protocols/protocols.h"
@@ -12,10 +13,6 @@
 #define INVALID_DATA (-1)
 #define is_invalid(x) ((x) == INVALID_DATA)
 
-typedef enum {
-    HANDSHAKE, PLAY, PING, LOGIN, CONFIGURATION, INVALID
-} je_state;
-
 typedef struct {
     guint8 *server_decrypt;
     guint8 *client_decrypt;
@@ -55,10 +52,117 @@ gint read_var_int(const guint8 *data, guint max_length, guint *result);
 
 gint read_var_long(const guint8 *data, guint max_length, guint64 *result);
 
+// Length of count VarInts, for arrays whose values are not needed
+gint skip_var_ints(const guint8 *data, guint max_length, guint count);
+
 gint read_ushort(const guint8 *data, guint16 *result);
 
 gint read_ulong(const guint8 *data, guint64 *result);
 
-gint read_buffer(const guint8 *data, guint8 **result);
+gint read_buffer(const guint8 *data, guint max_length, guint8 **result);
+
+// Big endian values of bytes that are already known to be there
+static inline guint16 peek_u16(const guint8 *data) {
+    guint16 value;
+    memcpy(&value, data, sizeof(value));
+    return GUINT16_FROM_BE(value);
+}
+
+static inline guint32 peek_u32(const guint8 *data) {
+    guint32 value;
+    memcpy(&value, data, sizeof(value));
+    return GUINT32_FROM_BE(value);
+}
+
+static inline guint64 peek_u64(const guint8 *data) {
+    guint64 value;
+    memcpy(&value, data, sizeof(value));
+    return GUINT64_FROM_BE(value);
+}
+
+static inline float peek_f32(const guint8 *data) {
+    guint32 bits = peek_u32(data);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline double peek_f64(const guint8 *data) {
+    guint64 bits = peek_u64(data);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Bytes of a packet read from the start to the end. A fixed width part is checked once with slice_need and then read
+// with the unchecked reads, a part whose length comes from the data uses the checked ones. A checked read past the end
+// marks the slice as failed and reads zeros, so a malformed value ends its loops quickly.
+typedef struct {
+    const guint8 *now;
+    const guint8 *end;
+    bool failed;
+} data_slice;
+
+static inline data_slice make_slice(const guint8 *data, guint length) {
+    data_slice slice = {data, data + length, false};
+    return slice;
+}
+
+static inline bool slice_need(data_slice *slice, guint64 length) {
+    if ((guint64) (slice->end - slice->now) >= length)
+        return true;
+    slice->now = slice->end;
+    slice->failed = true;
+    return false;
+}
+
+static inline void slice_fail(data_slice *slice) {
+    slice->now = slice->end;
+    slice->failed = true;
+}
+
+static inline guint8 slice_u8_unchecked(data_slice *slice) {
+    return *slice->now++;
+}
+
+static inline guint16 slice_u16_unchecked(data_slice *slice) {
+    guint16 value = peek_u16(slice->now);
+    slice->now += 2;
+    return value;
+}
+
+static inline guint32 slice_u32_unchecked(data_slice *slice) {
+    guint32 value = peek_u32(slice->now);
+    slice->now += 4;
+    return value;
+}
+
+static inline guint8 slice_u8(data_slice *slice) {
+    return slice_need(slice, 1) ? slice_u8_unchecked(slice) : 0;
+}
+
+static inline guint16 slice_u16(data_slice *slice) {
+    return slice_need(slice, 2) ? slice_u16_unchecked(slice) : 0;
+}
+
+static inline guint32 slice_u32(data_slice *slice) {
+    return slice_need(slice, 4) ? slice_u32_unchecked(slice) : 0;
+}
+
+static inline guint32 slice_var_int(data_slice *slice) {
+    guint value;
+    gint read = read_var_int(slice->now, (guint) (slice->end - slice->now), &value);
+    if (is_invalid(read)) {
+        slice_fail(slice);
+        return 0;
+    }
+    slice->now += read;
+    return value;
+}
+
+static inline void slice_skip(data_slice *slice, guint64 length) {
+    if (slice_need(slice, length))
+        slice->now += length;
+}
 
 #endif //MC_DISSECTOR_PROTOCOL_DATA_H
@@ -36,19 +36,19 @@ void sub_dissect_je(guint length, tvbuff_t *tvb, packet_info *pinfo,
                     handle_server_slp(tree, tvb, pinfo, data, length, ctx);
                 return;
             case LOGIN:
-                if (!visited && is_invalid(handle_server_login_switch(data, length, ctx, pinfo)))
+                if (!visited && is_invalid(handle_state_switch(data, length, ctx, false)))
                     return;
                 if (tree)
                     handle_login(tree, tvb, pinfo, data, length, ctx, false);
                 return;
             case PLAY:
-                if (!visited && is_invalid(handle_server_play_switch(data, length, ctx)))
+                if (!visited && is_invalid(handle_state_switch(data, length, ctx, false)))
                     return;
                 if (tree)
                     handle_play(tree, tvb, pinfo, data, length, ctx, false);
                 return;
             case CONFIGURATION:
-                if (!visited && is_invalid(handle_server_configuration_switch(data, length, ctx)))
+                if (!visited && is_invalid(handle_state_switch(data, length, ctx, false)))
                     return;
                 if (tree)
                     handle_configuration(tree, tvb, pinfo, data, length, ctx, false);
@@ -64,19 +64,19 @@ void sub_dissect_je(guint length, tvbuff_t *tvb, packet_info *pinfo,
                     handle_client_slp(tree, tvb, pinfo, data, length, ctx);
                 return;
             case LOGIN:
-                if (!visited && is_invalid(handle_client_login_switch(data, length, ctx)))
+                if (!visited && is_invalid(handle_state_switch(data, length, ctx, true)))
                     return;
                 if (tree)
                     handle_login(tree, tvb, pinfo, data, length, ctx, true);
                 return;
             case PLAY:
-                if (!visited && is_invalid(handle_client_play_switch(data, length, ctx)))
+                if (!visited && is_invalid(handle_state_switch(data, length, ctx, true)))
                     return;
                 if (tree)
                     handle_play(tree, tvb, pinfo, data, length, ctx, true);
                 return;
             case CONFIGURATION:
-                if (!visited && is_invalid(handle_client_configuration_switch(data, length, ctx)))
+                if (!visited && is_invalid(handle_state_switch(data, length, ctx, true)))
                     return;
                 if (tree)
                     handle_configuration(tree, tvb, pinfo, data, length, ctx, true);
@@ -131,7 +131,14 @@ int dissect_je_core(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *d
     read_pointer += packet_length_length;
     col_append_fstr(pinfo->cinfo, COL_INFO, " (%d bytes)", packet_length_vari);
 
-    proto_tree *mcje_tree;
+    // Fields are only decoded for a tree that is shown or filtered on, other passes only follow the states
+    if (!proto_field_is_referenced(tree, proto_mcje)) {
+        if (pinfo->fd->visited)
+            return tvb_captured_length(tvb);
+        tree = NULL;
+    }
+
+    proto_tree *mcje_tree = NULL;
     if (tree) {
         proto_item *ti = proto_tree_add_item(tree, proto_mcje, tvb, 0, -1, FALSE);
         mcje_tree = proto_item_add_subtree(ti, ett_mcje);
@@ -6,6 +6,7 @@
 #define MC_DISSECTOR_JE_DISSECT_H
 
 #include <epan/packet.h>
+#include "mc_dissector.h"
 #include "protocol_data.h"
 
 extern dissector_handle_t mcje_handle;
@@ -37,16 +38,20 @@ extern int hf_unknown_string_je;
 extern int hf_unknown_boolean_je;
 extern int hf_unknown_uuid_je;
 extern int hf_array_length_je;
+extern int hf_array_data_je;
+extern int hf_nbt_tag_je;
+extern int hf_non_air_blocks_je;
+extern int hf_bits_per_entry_je;
+extern int hf_palette_entry_je;
+extern int hf_paletted_entry_je;
 
 extern int ett_mcje;
 extern int ett_je_proto;
 extern int ett_sub_je;
-extern wmem_map_t *name_hf_map_je;
-extern wmem_map_t *complex_name_map_je;
 extern wmem_map_t *complex_hf_map_je;
 extern wmem_map_t *unknown_hf_map_je;
 extern wmem_map_t *bitmask_hf_map_je;
-extern wmem_map_t *component_map_je;
+extern const name_trie_node name_trie_je[];
 
 void proto_register_mcje();
 
@@ -25,6 +25,8 @@ int handle_server_handshake_switch(const guint8 *data, guint length, mcje_protoc
         read = read_var_int(data + p, length - p, &str_len);
         if (is_invalid(read))
             return INVALID_DATA;
+        if (length - p - read < 2 || str_len > length - p - read - 2)
+            return INVALID_DATA;
         p += read + str_len + 2;
         guint next_state;
         read = read_var_int(data + p, length - p, &next_state);
@@ -76,8 +78,8 @@ void handle_server_handshake(proto_tree *packet_tree, tvbuff_t *tvb, packet_info
         p += read;
 
         guint8 *server_address;
-        read = read_buffer(data + p, &server_address);
-        if (is_invalid(read)) {
+        read = read_buffer(data + p, length - p, &server_address);
+        if (is_invalid(read) || length - p - read < 2) {
             proto_tree_add_string(packet_tree, hf_server_address_je, tvb, p, -1, "Invalid Server Address");
             return;
         }
@@ -143,7 +145,7 @@ void handle_client_slp(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinf
     if (packet_id == PACKET_ID_CLIENT_SERVER_INFO) {
         proto_tree_add_string(packet_tree, hf_packet_name_je, tvb, 0, read, "Client Server Info");
         guint8 *server_info;
-        read = read_buffer(data + p, &server_info);
+        read = read_buffer(data + p, length - p, &server_info);
         if (is_invalid(read)) {
             proto_tree_add_string(packet_tree, hf_invalid_data_je, tvb, p, -1, "Invalid Server Info");
             return;
@@ -162,25 +164,10 @@ void handle_client_slp(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinf
         proto_tree_add_string(packet_tree, hf_packet_name_je, tvb, 0, read, "Unknown Packet ID");
 }
 
-int handle_client_login_switch(const guint8 *data, guint length, mcje_protocol_context *ctx) {
-    if (ctx->protocol_set == NULL) {
-        ctx->client_state = ctx->server_state = INVALID;
-        return -1;
-    }
-    guint packet_id;
-    guint read;
-    guint p = read_var_int(data, length, &packet_id);
-    if (is_invalid(p))
-        return INVALID_DATA;
-    if (packet_id == PACKET_ID_CLIENT_SUCCESS) {
-        if (ctx->data_version >= 3567)
-            ctx->client_state = CONFIGURATION;
-        else
-            ctx->client_state = ctx->server_state = PLAY;
-    }
+int handle_client_login_packet(const guint8 *data, guint length, guint packet_id, mcje_protocol_context *ctx) {
     if (packet_id == PACKET_ID_CLIENT_COMPRESS) {
         guint threshold;
-        read = read_var_int(data + p, length - p, &threshold);
+        gint read = read_var_int(data, length, &threshold);
         if (is_invalid(read))
             return INVALID_DATA;
         ctx->compression_threshold = threshold;
@@ -188,17 +175,7 @@ int handle_client_login_switch(const guint8 *data, guint length, mcje_protocol_c
     return 0;
 }
 
-int handle_server_login_switch(const guint8 *data, guint length, mcje_protocol_context *ctx, packet_info *pinfo) {
-    if (ctx->protocol_set == NULL) {
-        ctx->client_state = ctx->server_state = INVALID;
-        return -1;
-    }
-    guint packet_id;
-    guint p = read_var_int(data, length, &packet_id);
-    if (is_invalid(p))
-        return INVALID_DATA;
-    if (packet_id == get_packet_id(ctx->protocol_set->login, "login_acknowledgement", false))
-        ctx->server_state = CONFIGURATION;
+int handle_server_login_packet(guint packet_id, mcje_protocol_context *ctx) {
     if (packet_id == PACKET_ID_SERVER_ENCRYPTION_BEGIN) {
         gchar *secret_key_str = pref_secret_key;
         if (strlen(secret_key_str) != 32) {
@@ -230,6 +207,29 @@ int handle_server_login_switch(const guint8 *data, guint length, mcje_protocol_c
     return 0;
 }
 
+int handle_state_switch(const guint8 *data, guint length, mcje_protocol_context *ctx, bool is_client) {
+    if (ctx->protocol_set == NULL) {
+        ctx->client_state = ctx->server_state = INVALID;
+        return -1;
+    }
+    guint packet_id;
+    gint p = read_var_int(data, length, &packet_id);
+    if (is_invalid(p))
+        return INVALID_DATA;
+    je_state state = is_client ? ctx->client_state : ctx->server_state;
+    je_state_transition *transition = &ctx->protocol_set->transitions[state][is_client];
+    if (transition->packet_id == (gint) packet_id) {
+        if (is_client || transition->both_sides)
+            ctx->client_state = transition->next_state;
+        if (!is_client || transition->both_sides)
+            ctx->server_state = transition->next_state;
+    }
+    if (state != LOGIN)
+        return 0;
+    return is_client ? handle_client_login_packet(data + p, length - p, packet_id, ctx)
+                     : handle_server_login_packet(packet_id, ctx);
+}
+
 void handle(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
             guint length, mcje_protocol_context *ctx, protocol_set protocol_set, bool is_client) {
     guint packet_id;
@@ -258,55 +258,38 @@ void handle(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, cons
         proto_tree_add_string_format_value(packet_tree, hf_packet_name_je, tvb, 0, read, packet_name,
                                            "%s (%s)", better_name, packet_name);
 
-    bool ignore = false;
-    if (strlen(pref_ignore_packets_je) != 0) {
-        gchar *search_name = g_strdup_printf("%s:%s", is_client ? "c" : "s", packet_name);
-        GList *list = prefs_get_string_list(pref_ignore_packets_je);
-        ignore = g_list_find_custom(list, search_name, (GCompareFunc) g_strcmp0) != NULL;
-    }
-    if (ignore)
+    if (is_packet_ignored_je(packet_name, is_client))
         proto_tree_add_string(packet_tree, hf_ignored_packet_je, tvb, p, length - p, "Ignored by user");
     else if (!make_tree(protocol, packet_tree, tvb, ctx->extra, data, length))
         proto_tree_add_string(packet_tree, hf_ignored_packet_je, tvb, p, length - p,
                               "Protocol hasn't been implemented yet");
 }
 
-void handle_login(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
-                  guint length, mcje_protocol_context *ctx, bool is_client) {
-    if (ctx->protocol_set == NULL) {
-        proto_tree_add_string(packet_tree, hf_invalid_data_je, tvb, 0, 1, "Can't find protocol set for this version");
-        ctx->client_state = ctx->server_state = INVALID;
-        return;
-    }
-    handle(packet_tree, tvb, pinfo, data, length, ctx, ctx->protocol_set->login, is_client);
+// "c:name" and "s:name" entries of the ignore preference, split once when the preference is applied
+GList *ignored_packets_je = NULL;
+
+void set_ignored_packets_je(const gchar *pref) {
+    prefs_clear_string_list(ignored_packets_je);
+    ignored_packets_je = prefs_get_string_list(pref);
 }
 
-int handle_client_play_switch(const guint8 *data, guint length, mcje_protocol_context *ctx) {
-    if (ctx->protocol_set == NULL) {
-        ctx->client_state = ctx->server_state = INVALID;
-        return -1;
+bool is_packet_ignored_je(const gchar *packet_name, bool is_client) {
+    for (GList *now = ignored_packets_je; now != NULL; now = now->next) {
+        const gchar *entry = now->data;
+        if (entry[0] == (is_client ? 'c' : 's') && entry[1] == ':' && strcmp(entry + 2, packet_name) == 0)
+            return true;
     }
-    guint packet_id;
-    guint p = read_var_int(data, length, &packet_id);
-    if (is_invalid(p))
-        return INVALID_DATA;
-    if (packet_id == get_packet_id(ctx->protocol_set->play, "start_configuration", true))
-        ctx->client_state = CONFIGURATION;
-    return 0;
+    return false;
 }
 
-int handle_server_play_switch(const guint8 *data, guint length, mcje_protocol_context *ctx) {
+void handle_login(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
+                  guint length, mcje_protocol_context *ctx, bool is_client) {
     if (ctx->protocol_set == NULL) {
+        proto_tree_add_string(packet_tree, hf_invalid_data_je, tvb, 0, 1, "Can't find protocol set for this version");
         ctx->client_state = ctx->server_state = INVALID;
-        return -1;
+        return;
     }
-    guint packet_id;
-    guint p = read_var_int(data, length, &packet_id);
-    if (is_invalid(p))
-        return INVALID_DATA;
-    if (packet_id == get_packet_id(ctx->protocol_set->play, "configuration_acknowledgement", false))
-        ctx->server_state = CONFIGURATION;
-    return 0;
+    handle(packet_tree, tvb, pinfo, data, length, ctx, ctx->protocol_set->login, is_client);
 }
 
 void handle_play(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
@@ -319,34 +302,6 @@ void handle_play(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_,
     handle(packet_tree, tvb, pinfo, data, length, ctx, ctx->protocol_set->play, is_client);
 }
 
-int handle_client_configuration_switch(const guint8 *data, guint length, mcje_protocol_context *ctx) {
-    if (ctx->protocol_set == NULL) {
-        ctx->client_state = ctx->server_state = INVALID;
-        return -1;
-    }
-    guint packet_id;
-    guint p = read_var_int(data, length, &packet_id);
-    if (is_invalid(p))
-        return INVALID_DATA;
-    if (packet_id == get_packet_id(ctx->protocol_set->configuration, "finish_configuration", true))
-        ctx->client_state = PLAY;
-    return 0;
-}
-
-int handle_server_configuration_switch(const guint8 *data, guint length, mcje_protocol_context *ctx) {
-    if (ctx->protocol_set == NULL) {
-        ctx->client_state = ctx->server_state = INVALID;
-        return -1;
-    }
-    guint packet_id;
-    guint p = read_var_int(data, length, &packet_id);
-    if (is_invalid(p))
-        return INVALID_DATA;
-    if (packet_id == get_packet_id(ctx->protocol_set->configuration, "finish_configuration", false))
-        ctx->server_state = PLAY;
-    return 0;
-}
-
 void handle_configuration(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
                           guint length, mcje_protocol_context *ctx, bool is_client) {
     if (ctx->protocol_set == NULL) {
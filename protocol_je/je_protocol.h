@@ -14,10 +14,13 @@
 #define PACKET_ID_SERVER_PING 0x01
 #define PACKET_ID_CLIENT_SERVER_INFO 0x00
 #define PACKET_ID_CLIENT_PING 0x01
-#define PACKET_ID_CLIENT_SUCCESS 0x02
 #define PACKET_ID_CLIENT_COMPRESS 0x03
 #define PACKET_ID_SERVER_ENCRYPTION_BEGIN 0x01
 
+void set_ignored_packets_je(const gchar *pref);
+
+bool is_packet_ignored_je(const gchar *packet_name, bool is_client);
+
 int handle_server_handshake_switch(const guint8 *data, guint length, mcje_protocol_context *ctx);
 
 void handle_server_handshake(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
@@ -29,24 +32,15 @@ void handle_server_slp(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinf
 void handle_client_slp(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
                        guint length, mcje_protocol_context *ctx);
 
-int handle_client_login_switch(const guint8 *data, guint length, mcje_protocol_context *ctx);
-
-int handle_server_login_switch(const guint8 *data, guint length, mcje_protocol_context *ctx, packet_info *pinfo);
+// Follows the state transitions of the protocol set, login packets also set up compression and encryption
+int handle_state_switch(const guint8 *data, guint length, mcje_protocol_context *ctx, bool is_client);
 
 void handle_login(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
                   guint length, mcje_protocol_context *ctx, bool is_client);
 
-int handle_client_play_switch(const guint8 *data, guint length, mcje_protocol_context *ctx);
-
-int handle_server_play_switch(const guint8 *data, guint length, mcje_protocol_context *ctx);
-
 void handle_play(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
                  guint length, mcje_protocol_context *ctx, bool is_client);
 
-int handle_client_configuration_switch(const guint8 *data, guint length, mcje_protocol_context *ctx);
-
-int handle_server_configuration_switch(const guint8 *data, guint length, mcje_protocol_context *ctx);
-
 void handle_configuration(proto_tree *packet_tree, tvbuff_t *tvb, packet_info *pinfo _U_, const guint8 *data,
                           guint length, mcje_protocol_context *ctx, bool is_client);
 
@@ -8,19 +8,46 @@
 #include "je_protocol.h"
 
 module_t *pref_mcje = NULL;
-gchar *pref_ignore_packets_je = "c:map_chunk";
+gchar *pref_ignore_packets_je = "";
 gchar *pref_secret_key = "";
+gchar *pref_warm_up_versions_je = "";
+guint pref_max_array_elements_je = 1000;
+guint pref_nbt_depth_je = 16;
+
+void apply_prefs_je() {
+    set_ignored_packets_je(pref_ignore_packets_je);
+    start_warm_up_je(pref_warm_up_versions_je);
+    set_array_element_limit(pref_max_array_elements_je);
+    set_nbt_depth_limit(pref_nbt_depth_je);
+}
 
 void proto_register_mcje() {
     proto_mcje = proto_register_protocol(MCJE_NAME, MCJE_SHORT_NAME, MCJE_FILTER);
 
     // Preference ------------------------------------------------------------------------------------------------------
-    pref_mcje = prefs_register_protocol(proto_mcje, NULL);
+    pref_mcje = prefs_register_protocol(proto_mcje, apply_prefs_je);
     prefs_register_string_preference(pref_mcje, "ignore_packets", "Ignore Packets",
                                      "Ignore packets with the given names", (const char **) &pref_ignore_packets_je);
     prefs_register_string_preference(pref_mcje, "secret_key", "Secret Key",
                                      "Secret key for decryption", (const char **) &pref_secret_key);
+    prefs_register_string_preference(pref_mcje, "warm_up_versions", "Warm-up Versions",
+                                     "Versions to compile in background after loading. \"latest N\" compiles the N "
+                                     "newest versions, a comma separated list of version names (such as "
+                                     "\"1.20.2, 1.20.1\") compiles those. Empty by default, versions are then "
+                                     "compiled when a capture first uses them",
+                                     (const char **) &pref_warm_up_versions_je);
+    prefs_register_uint_preference(pref_mcje, "max_array_elements", "Maximum Array Elements",
+                                   "Most elements of an array shown in the tree, the rest are shown as one item, "
+                                   "0 to show all", 10, &pref_max_array_elements_je);
+    prefs_register_uint_preference(pref_mcje, "nbt_depth", "NBT Tree Depth",
+                                   "Most levels of nested NBT tags shown in the tree, 0 to only show the bytes", 10,
+                                   &pref_nbt_depth_je);
+    set_ignored_packets_je(pref_ignore_packets_je);
+    set_array_element_limit(pref_max_array_elements_je);
+    set_nbt_depth_limit(pref_nbt_depth_je);
 
     register_string_je();
     init_je();
+    register_cleanup_routine(save_protocol_sets);
+    register_shutdown_routine(stop_warm_up_je);
 }
\ No newline at end of file
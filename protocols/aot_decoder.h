@@ -0,0 +1,34 @@
+#ifndef MC_DISSECTOR_AOT_DECODER_H
+#define MC_DISSECTOR_AOT_DECODER_H
+
+#include "protocol_functions.h"
+#include "protocol_je/je_dissect.h"
+
+// Decoders generated by decoder_gen.py for the packets of selected versions.
+// A generated decoder unrolls the containers of a packet and calls native fields directly, everything else is
+// still decoded by the compiled fields. It is only bound to an entry after check accepts the compiled field,
+// so a decoder that does not match the compiled shape falls back to the interpreter.
+
+typedef struct {
+    const gchar *name; // version/state/c or s/packet
+    bool (*check)(protocol_field field);
+    guint (*make_tree)(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                       protocol_field field, guint offset, guint remaining, data_recorder recorder);
+} aot_decoder;
+
+extern const aot_decoder AOT_DECODERS[];
+
+#define AOT_FIELD(index, func) { \
+    record_start(recorder, children[index]->slot); \
+    length = func(data, tree, tvb, extra, children[index], offset, remaining, recorder); \
+    offset += length; \
+    remaining -= length; \
+}
+
+#define AOT_ANONYMOUS_FIELD(index, func) { \
+    record_start(recorder, RECORD_SLOT_SAME); \
+    func(data, NULL, tvb, extra, children[index], offset, remaining, recorder); \
+    AOT_FIELD(index, func) \
+}
+
+#endif //MC_DISSECTOR_AOT_DECODER_H
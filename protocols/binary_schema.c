@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include "binary_schema.h"
+#include "protocolSchemas.h"
+
+#define NODE_TYPE(node) ((node)->head & 0x7)
+#define NODE_SIZE(node) ((node)->head >> 3)
+#define NODE_KEY(index) (SCHEMA_STRINGS + SCHEMA_NODES[index].key)
+
+// Indexes of the children of every object block sorted by key, at the same place as the block
+guint32 *sorted_children = NULL;
+
+gint compare_child_key(gconstpointer a, gconstpointer b) {
+    return strcmp(NODE_KEY(*(const guint32 *) a), NODE_KEY(*(const guint32 *) b));
+}
+
+void init_binary_schema(wmem_allocator_t *allocator) {
+    sorted_children = wmem_alloc_array(allocator, guint32, SCHEMA_NODE_COUNT);
+    for (guint32 i = 0; i < SCHEMA_NODE_COUNT; i++)
+        sorted_children[i] = i;
+    // Blocks are shared by equal objects, the first of them sorts it
+    guint8 *sorted = g_new0(guint8, SCHEMA_NODE_COUNT);
+    for (guint32 i = 0; i < SCHEMA_NODE_COUNT; i++) {
+        schema_node node = SCHEMA_NODES + i;
+        if (NODE_TYPE(node) != SCHEMA_OBJECT || NODE_SIZE(node) < 2 || sorted[node->value])
+            continue;
+        qsort(sorted_children + node->value, NODE_SIZE(node), sizeof(guint32), compare_child_key);
+        sorted[node->value] = true;
+    }
+    g_free(sorted);
+}
+
+schema_node schema_root(guint32 index) {
+    return SCHEMA_NODES + index;
+}
+
+guint schema_type(schema_node node) {
+    return node == NULL ? SCHEMA_NULL : NODE_TYPE(node);
+}
+
+bool schema_is_string(schema_node node) {
+    return node != NULL && NODE_TYPE(node) == SCHEMA_STRING;
+}
+
+bool schema_is_object(schema_node node) {
+    return node != NULL && NODE_TYPE(node) == SCHEMA_OBJECT;
+}
+
+guint schema_size(schema_node node) {
+    if (node == NULL || (NODE_TYPE(node) != SCHEMA_ARRAY && NODE_TYPE(node) != SCHEMA_OBJECT))
+        return 0;
+    return NODE_SIZE(node);
+}
+
+schema_node schema_at(schema_node node, guint index) {
+    if (index >= schema_size(node))
+        return NULL;
+    return SCHEMA_NODES + node->value + index;
+}
+
+schema_node schema_get(schema_node node, const gchar *key) {
+    if (!schema_is_object(node))
+        return NULL;
+    const guint32 *children = sorted_children + node->value;
+    guint low = 0, high = NODE_SIZE(node);
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        gint compared = strcmp(NODE_KEY(children[mid]), key);
+        if (compared == 0)
+            return SCHEMA_NODES + children[mid];
+        if (compared < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return NULL;
+}
+
+bool schema_has(schema_node node, const gchar *key) {
+    return schema_get(node, key) != NULL;
+}
+
+const gchar *schema_key(schema_node node) {
+    if (node == NULL || node->key == SCHEMA_NO_KEY)
+        return NULL;
+    return SCHEMA_STRINGS + node->key;
+}
+
+const gchar *schema_string(schema_node node) {
+    if (!schema_is_string(node))
+        return NULL;
+    return SCHEMA_STRINGS + node->value;
+}
+
+gint schema_int(schema_node node) {
+    if (node == NULL)
+        return 0;
+    guint type = NODE_TYPE(node);
+    if (type == SCHEMA_NUMBER)
+        return node->value;
+    return type == SCHEMA_TRUE;
+}
+
+bool schema_equals(schema_node a, schema_node b) {
+    if (a == NULL || b == NULL)
+        return a == b;
+    return a->head == b->head && a->value == b->value;
+}
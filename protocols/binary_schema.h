@@ -0,0 +1,63 @@
+#ifndef MC_DISSECTOR_BINARY_SCHEMA_H
+#define MC_DISSECTOR_BINARY_SCHEMA_H
+
+#include <epan/wmem_scopes.h>
+#include <stdbool.h>
+
+// Precompiled JSON documents generated by protocol_data_gen.py.
+// Every document lives in one flat node table with a shared string pool, children of an array or object
+// are stored contiguously, and identical blocks are shared between documents. Nothing in the tables is a
+// pointer, so they are used in place from read-only data without any parsing.
+
+#define SCHEMA_NULL   0
+#define SCHEMA_FALSE  1
+#define SCHEMA_TRUE   2
+#define SCHEMA_NUMBER 3
+#define SCHEMA_STRING 4
+#define SCHEMA_ARRAY  5
+#define SCHEMA_OBJECT 6
+
+#define SCHEMA_NO_KEY 0xFFFFFFFF
+
+typedef struct {
+    guint32 head;  // (size << 3) | type
+    guint32 key;   // offset in string pool of the key in the parent object, or SCHEMA_NO_KEY
+    gint32 value;  // number value, string offset or index of the first child
+} schema_node_t;
+
+typedef const schema_node_t *schema_node;
+
+typedef struct {
+    const char *name;
+    guint32 root;
+} schema_document;
+
+// Orders the keys of every object once, so that schema_get can search them
+void init_binary_schema(wmem_allocator_t *allocator);
+
+schema_node schema_root(guint32 index);
+
+guint schema_type(schema_node node);
+
+bool schema_is_string(schema_node node);
+
+bool schema_is_object(schema_node node);
+
+guint schema_size(schema_node node);
+
+schema_node schema_at(schema_node node, guint index);
+
+schema_node schema_get(schema_node node, const gchar *key);
+
+bool schema_has(schema_node node, const gchar *key);
+
+const gchar *schema_key(schema_node node);
+
+const gchar *schema_string(schema_node node);
+
+gint schema_int(schema_node node);
+
+// Identical subtrees share their child blocks, so this compares whole subtrees
+bool schema_equals(schema_node a, schema_node b);
+
+#endif //MC_DISSECTOR_BINARY_SCHEMA_H
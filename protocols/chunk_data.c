@@ -0,0 +1,193 @@
+#include "protocol_data.h"
+#include "protocol_functions.h"
+#include "protocol_je/je_dissect.h"
+
+// The schema only knows chunk data as bytes, its sections are read here. Without a tree only the length of the
+// buffer is read. With one the sections are listed with their palettes, and the entries of a container are unpacked
+// only as far as the array element limit shows them.
+
+typedef struct {
+    const gchar *name;
+    guint entries;
+    guint min_indirect_bits;
+    guint max_indirect_bits; // more bits are direct, the entries are values and there is no palette
+} container_kind;
+
+const container_kind BLOCK_STATES = {"Block States", 4096, 4, 8};
+const container_kind BIOMES = {"Biomes", 64, 1, 3};
+
+typedef struct {
+    const guint8 *start;
+    guint bits;           // as sent, 0 for a single value
+    guint entry_bits;     // of the entries in the longs
+    const guint8 *palette; // VarInts, the value of a single valued container is its only entry
+    guint palette_length;
+    const guint8 *longs;
+    guint long_count;
+} paletted_container;
+
+// Without a count the longs hold all entries of the container, none for a single value
+void read_paletted_container(data_slice *slice, const container_kind *kind, bool prefixed,
+                             paletted_container *container) {
+    container->start = slice->now;
+    container->bits = slice_u8(slice);
+    container->entry_bits = container->bits;
+    container->palette = slice->now;
+    container->palette_length = 0;
+    if (container->bits == 0) {
+        slice_var_int(slice);
+        container->palette_length = 1;
+    } else if (container->bits <= kind->max_indirect_bits) {
+        container->palette_length = slice_var_int(slice);
+        container->palette = slice->now;
+        gint length = skip_var_ints(slice->now, (guint) (slice->end - slice->now), container->palette_length);
+        if (is_invalid(length))
+            slice_fail(slice);
+        else
+            slice->now += length;
+        container->entry_bits = MAX(container->bits, kind->min_indirect_bits);
+    } else if (container->bits > 32)
+        slice_fail(slice);
+    if (prefixed)
+        container->long_count = slice_var_int(slice);
+    else if (container->bits == 0 || slice->failed)
+        container->long_count = 0;
+    else {
+        guint per_long = 64 / container->entry_bits;
+        container->long_count = (kind->entries + per_long - 1) / per_long;
+    }
+    container->longs = slice->now;
+    slice_skip(slice, (guint64) container->long_count * 8);
+}
+
+// Entries don't span two longs, the first one is in the lowest bits. The inner loop has a fixed shape for every long
+// so the compiler vectorizes it.
+void unpack_entries(const guint8 *longs, guint bits, guint32 *entries, guint count) {
+    guint per_long = 64 / bits;
+    guint64 mask = (G_GUINT64_CONSTANT(1) << bits) - 1;
+    for (; count > 0; longs += 8) {
+        guint64 word = peek_u64(longs);
+        guint unpacked = MIN(per_long, count);
+        for (guint i = 0; i < unpacked; i++)
+            entries[i] = (guint32) (word >> (i * bits) & mask);
+        entries += unpacked;
+        count -= unpacked;
+    }
+}
+
+void add_paletted_container(proto_tree *tree, tvbuff_t *tvb, const guint8 *data, const container_kind *kind,
+                            const paletted_container *container, const guint8 *end) {
+    guint offset = (guint) (container->start - data);
+    proto_tree *sub;
+    if (container->bits == 0)
+        sub = proto_tree_add_subtree_format(tree, tvb, offset, (gint) (end - container->start), ett_sub_je, NULL,
+                                            "%s (Single Value)", kind->name);
+    else if (container->bits <= kind->max_indirect_bits)
+        sub = proto_tree_add_subtree_format(tree, tvb, offset, (gint) (end - container->start), ett_sub_je, NULL,
+                                            "%s (Palette of %u, %u bits)", kind->name, container->palette_length,
+                                            container->entry_bits);
+    else
+        sub = proto_tree_add_subtree_format(tree, tvb, offset, (gint) (end - container->start), ett_sub_je, NULL,
+                                            "%s (Direct, %u bits)", kind->name, container->entry_bits);
+    proto_tree_add_uint(sub, hf_bits_per_entry_je, tvb, offset, 1, container->bits);
+
+    // The palette was checked while reading
+    bool indirect = container->bits != 0 && container->bits <= kind->max_indirect_bits;
+    guint32 *palette = wmem_alloc_array(wmem_packet_scope(), guint32, container->palette_length);
+    const guint8 *now = container->palette;
+    if (indirect)
+        proto_tree_add_uint(sub, hf_array_length_je, tvb, offset + 1, (gint) (container->palette - data) - offset - 1,
+                            container->palette_length);
+    guint shown_palette = get_shown_element_count(container->palette_length);
+    const guint8 *hidden_start = NULL;
+    for (guint i = 0; i < container->palette_length; i++) {
+        gint read = read_var_int(now, (guint) (container->longs - now), palette + i);
+        if (container->bits == 0)
+            proto_tree_add_uint(sub, hf_palette_entry_je, tvb, (gint) (now - data), read, palette[i]);
+        else if (i < shown_palette)
+            proto_tree_add_uint_format_value(sub, hf_palette_entry_je, tvb, (gint) (now - data), read, palette[i],
+                                             "%s %u", get_element_label(i), palette[i]);
+        else if (hidden_start == NULL)
+            hidden_start = now;
+        now += read;
+    }
+    if (hidden_start != NULL)
+        add_hidden_elements(sub, tvb, container->palette_length - shown_palette, (guint) (hidden_start - data),
+                            (guint) (now - hidden_start), true);
+
+    guint longs_offset = (guint) (container->longs - data);
+    if (container->longs > now) // not sent since 1.21.5
+        proto_tree_add_uint(sub, hf_array_length_je, tvb, (gint) (now - data), (gint) (container->longs - now),
+                            container->long_count);
+    if (container->bits == 0)
+        return;
+    guint per_long = 64 / container->entry_bits;
+    guint count = (guint) MIN((guint64) container->long_count * per_long, kind->entries);
+    guint shown = get_shown_element_count(count);
+    guint32 *entries = wmem_alloc_array(wmem_packet_scope(), guint32, shown);
+    unpack_entries(container->longs, container->entry_bits, entries, shown);
+    for (guint i = 0; i < shown; i++) {
+        gint entry_offset = (gint) (longs_offset + i / per_long * 8);
+        if (!indirect)
+            proto_tree_add_uint_format_value(sub, hf_paletted_entry_je, tvb, entry_offset, 8, entries[i], "%s %u",
+                                             get_element_label(i), entries[i]);
+        else if (entries[i] < container->palette_length)
+            proto_tree_add_uint_format_value(sub, hf_paletted_entry_je, tvb, entry_offset, 8, palette[entries[i]],
+                                             "%s %u (palette %u)", get_element_label(i), palette[entries[i]],
+                                             entries[i]);
+        else
+            proto_tree_add_uint_format_value(sub, hf_paletted_entry_je, tvb, entry_offset, 8, entries[i],
+                                             "%s palette %u out of range", get_element_label(i), entries[i]);
+    }
+    if (shown < count) {
+        guint hidden_offset = longs_offset + shown / per_long * 8;
+        add_hidden_elements(sub, tvb, count - shown, hidden_offset, (guint) (end - data) - hidden_offset, true);
+    }
+}
+
+void add_chunk_sections(proto_tree *tree, tvbuff_t *tvb, const guint8 *data, guint offset, guint length,
+                        bool prefixed) {
+    data_slice slice = make_slice(data + offset, length);
+    for (guint i = 0; slice.now < slice.end; i++) {
+        const guint8 *start = slice.now;
+        gint16 non_air_blocks = (gint16) slice_u16(&slice);
+        paletted_container block_states, biomes;
+        read_paletted_container(&slice, &BLOCK_STATES, prefixed, &block_states);
+        const guint8 *biomes_start = slice.now;
+        read_paletted_container(&slice, &BIOMES, prefixed, &biomes);
+        if (slice.failed) {
+            proto_tree_add_string(tree, hf_invalid_data_je, tvb, (gint) (start - data),
+                                  (gint) (data + offset + length - start), "Invalid chunk section");
+            return;
+        }
+        proto_tree *section = proto_tree_add_subtree_format(tree, tvb, (gint) (start - data),
+                                                            (gint) (slice.now - start), ett_sub_je, NULL,
+                                                            "Section %u (%d non-air blocks)", i, non_air_blocks);
+        proto_tree_add_int(section, hf_non_air_blocks_je, tvb, (gint) (start - data), 2, non_air_blocks);
+        add_paletted_container(section, tvb, data, &BLOCK_STATES, &block_states, biomes_start);
+        add_paletted_container(section, tvb, data, &BIOMES, &biomes, slice.now);
+    }
+}
+
+guint add_chunk_data(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, protocol_field field, guint offset,
+                     guint remaining, bool prefixed) {
+    guint length;
+    gint read = read_var_int(data + offset, remaining, &length);
+    CHECK_READ(read)
+    CHECK_LENGTH((guint64) read + length)
+    if (tree) {
+        proto_item *item = proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length + read,
+                                                tvb_memdup(wmem_packet_scope(), tvb, offset + read,
+                                                           MIN(length, BYTES_MAX_LENGTH)));
+        add_chunk_sections(proto_item_add_subtree(item, ett_sub_je), tvb, data, offset + read, length, prefixed);
+    }
+    return read + length;
+}
+
+FIELD_MAKE_TREE(chunk_data) {
+    return add_chunk_data(data, tree, tvb, field, offset, remaining, true);
+}
+
+FIELD_MAKE_TREE(unprefixed_chunk_data) {
+    return add_chunk_data(data, tree, tvb, field, offset, remaining, false);
+}
@@ -2,143 +2,383 @@
 // Created by Nickid2018 on 2023/7/14.
 //
 
+#include <string.h>
 #include "data_recorder.h"
+#include "mc_dissector.h"
+
+#define RECORD_INITIAL_VALUES 256
+#define RECORD_INITIAL_FRAMES 32
+#define RECORD_INITIAL_DEPTH 16
+#define RECORD_INITIAL_ALIASES 8
+#define RECORD_INITIAL_SLOTS 256
+
+typedef enum {
+    RECORD_POINTER,
+    RECORD_BOOL,
+    RECORD_UINT,
+    RECORD_UINT64,
+    RECORD_INT,
+    RECORD_INT64,
+    RECORD_FLOAT,
+    RECORD_DOUBLE,
+    RECORD_FRAME
+} record_type;
+
+typedef struct {
+    record_slot slot;
+    record_type type;
+    guint next; // earlier value of the same frame, 0 if none
+    union {
+        gint64 int_value;
+        guint64 uint_value;
+        double double_value;
+        void *pointer;
+        guint frame;
+    };
+} recorded_value;
+
+typedef struct {
+    guint parent;
+    guint last; // latest value, so a name recorded again hides the older one
+} record_frame;
 
 struct _data_recorder {
-    wmem_map_t *store_map;
-    gchar *recording_path;
-    gchar *recording;
-    wmem_map_t *alias_map;
+    recorded_value *values; // the first one is never used
+    guint value_count;
+    guint value_capacity;
+    record_frame *frames;   // the first one is the packet
+    guint frame_count;
+    guint frame_capacity;
+    guint current;
+    guint *stack;           // frames to go back to when popping
+    guint depth;
+    guint stack_capacity;
+    record_slot recording;
+    gchar *label;           // subtree label given to the field being decoded
+    record_slot *alias_names;
+    record_slot *alias_slots;
+    guint alias_count;
+    guint alias_capacity;
 };
 
+wmem_allocator_t *slot_scope = NULL;
+wmem_map_t *slot_map = NULL; // name -> slot
+guint slot_count = 0;
+guint slot_capacity = 0;
+// Slots named by a compiled path, values of other slots are never read so they are not recorded
+guint8 *slot_queried = NULL;
+
+void init_data_recorder(wmem_allocator_t *allocator) {
+    slot_scope = allocator;
+    slot_map = wmem_map_new(allocator, g_str_hash, g_str_equal);
+    slot_capacity = RECORD_INITIAL_SLOTS;
+    slot_queried = g_new0(guint8, slot_capacity);
+    slot_count = RECORD_SLOT_PARENT;
+    record_intern("..");
+    record_intern("__mapperValue");
+    record_intern("[unnamed]");
+    record_use(RECORD_SLOT_SAME);
+    record_use(RECORD_SLOT_MAPPER_VALUE);
+}
+
+record_slot record_intern(const gchar *name) {
+    record_slot slot = GPOINTER_TO_UINT(wmem_map_lookup(slot_map, name));
+    if (slot != RECORD_SLOT_NONE)
+        return slot;
+    if (slot_count == slot_capacity) {
+        slot_queried = g_renew(guint8, slot_queried, slot_capacity * 2);
+        memset(slot_queried + slot_capacity, 0, slot_capacity);
+        slot_capacity *= 2;
+    }
+    slot = slot_count++;
+    wmem_map_insert(slot_map, wmem_strdup(slot_scope, name), GUINT_TO_POINTER(slot));
+    return slot;
+}
+
+void record_use(record_slot slot) {
+    slot_queried[slot] = true;
+}
+
+record_path record_compile_path(wmem_allocator_t *allocator, gchar **source) {
+    record_path path = wmem_new(allocator, record_path_t);
+    path->source = source;
+    path->length = g_strv_length(source);
+    path->slots = wmem_alloc_array(allocator, record_slot, path->length);
+    for (guint i = 0; i < path->length; i++) {
+        path->slots[i] = record_intern(source[i]);
+        record_use(path->slots[i]);
+    }
+    return path;
+}
+
 data_recorder create_data_recorder() {
-    data_recorder recorder = wmem_new(wmem_packet_scope(), data_recorder_t);
-    recorder->store_map = wmem_map_new(wmem_packet_scope(), g_str_hash, g_str_equal);
-    recorder->alias_map = wmem_map_new(wmem_packet_scope(), g_str_hash, g_str_equal);
-    recorder->recording_path = "";
-    recorder->recording = NULL;
+    data_recorder recorder = g_new(data_recorder_t, 1);
+    recorder->value_capacity = RECORD_INITIAL_VALUES;
+    recorder->values = g_new(recorded_value, recorder->value_capacity);
+    recorder->frame_capacity = RECORD_INITIAL_FRAMES;
+    recorder->frames = g_new(record_frame, recorder->frame_capacity);
+    recorder->stack_capacity = RECORD_INITIAL_DEPTH;
+    recorder->stack = g_new(guint, recorder->stack_capacity);
+    recorder->alias_capacity = RECORD_INITIAL_ALIASES;
+    recorder->alias_names = g_new(record_slot, recorder->alias_capacity);
+    recorder->alias_slots = g_new(record_slot, recorder->alias_capacity);
+    record_reset(recorder);
     return recorder;
 }
 
 void destroy_data_recorder(data_recorder recorder) {
-    wmem_free(wmem_packet_scope(), recorder);
+    g_free(recorder->values);
+    g_free(recorder->frames);
+    g_free(recorder->stack);
+    g_free(recorder->alias_names);
+    g_free(recorder->alias_slots);
+    g_free(recorder);
+}
+
+void record_reset(data_recorder recorder) {
+    recorder->value_count = 1;
+    recorder->frame_count = 1;
+    recorder->frames[0].parent = 0;
+    recorder->frames[0].last = 0;
+    recorder->current = 0;
+    recorder->depth = 0;
+    recorder->recording = RECORD_SLOT_NONE;
+    recorder->label = NULL;
+    recorder->alias_count = 0;
+}
+
+void record_start(data_recorder recorder, record_slot slot) {
+    recorder->recording = slot_queried[slot] ? slot : RECORD_SLOT_NONE;
+    recorder->label = NULL;
+}
+
+void record_start_element(data_recorder recorder, gchar *label) {
+    recorder->recording = RECORD_SLOT_NONE;
+    recorder->label = label;
 }
 
-void record_start(data_recorder recorder, gchar *name) {
-    recorder->recording = name;
+gchar *record_take_label(data_recorder recorder, gchar *display_name) {
+    gchar *label = recorder->label;
+    recorder->label = NULL;
+    return label != NULL ? label : display_name;
+}
+
+void record_pass_label(data_recorder recorder, gchar *display_name) {
+    if (recorder->label == NULL)
+        recorder->label = display_name;
+}
+
+void record_drop_label(data_recorder recorder) {
+    recorder->label = NULL;
+}
+
+recorded_value *record_add(data_recorder recorder, record_slot slot, record_type type) {
+    if (recorder->value_count == recorder->value_capacity) {
+        recorder->value_capacity *= 2;
+        recorder->values = g_renew(recorded_value, recorder->values, recorder->value_capacity);
+        COUNT_DECODE_ALLOCATION();
+    }
+    guint index = recorder->value_count++;
+    record_frame *frame = recorder->frames + recorder->current;
+    recorded_value *value = recorder->values + index;
+    value->slot = slot;
+    value->type = type;
+    value->next = frame->last;
+    frame->last = index;
+    return value;
+}
+
+recorded_value *record_value(data_recorder recorder, record_type type) {
+    if (recorder->recording == RECORD_SLOT_NONE || recorder->recording == RECORD_SLOT_SAME)
+        return NULL;
+    return record_add(recorder, recorder->recording, type);
 }
 
 void *record(data_recorder recorder, void *data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL), data);
+    recorded_value *value = record_value(recorder, RECORD_POINTER);
+    if (value != NULL)
+        value->pointer = data;
     return data;
 }
 
 guint32 record_bool(data_recorder recorder, guint32 data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    data == 0 ? "false" : "true");
+    recorded_value *value = record_value(recorder, RECORD_BOOL);
+    if (value != NULL)
+        value->int_value = data;
     return data;
 }
 
 guint32 record_uint(data_recorder recorder, guint32 data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    g_strdup_printf("%u", data));
+    recorded_value *value = record_value(recorder, RECORD_UINT);
+    if (value != NULL)
+        value->int_value = data;
     return data;
 }
 
 guint64 record_uint64(data_recorder recorder, guint64 data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    g_strdup_printf("%llu", data));
+    recorded_value *value = record_value(recorder, RECORD_UINT64);
+    if (value != NULL)
+        value->uint_value = data;
     return data;
 }
 
 gint32 record_int(data_recorder recorder, gint32 data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    g_strdup_printf("%d", data));
+    recorded_value *value = record_value(recorder, RECORD_INT);
+    if (value != NULL)
+        value->int_value = data;
     return data;
 }
 
 gint64 record_int64(data_recorder recorder, gint64 data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    g_strdup_printf("%lld", data));
+    recorded_value *value = record_value(recorder, RECORD_INT64);
+    if (value != NULL)
+        value->int_value = data;
     return data;
 }
 
 float record_float(data_recorder recorder, float data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    g_strdup_printf("%f", data));
+    recorded_value *value = record_value(recorder, RECORD_FLOAT);
+    if (value != NULL)
+        value->double_value = data;
     return data;
 }
 
 double record_double(data_recorder recorder, double data) {
-    if (recorder->recording == NULL)
-        return data;
-    wmem_map_insert(recorder->store_map, g_strconcat(recorder->recording_path, "/", recorder->recording, NULL),
-                    g_strdup_printf("%lf", data));
+    recorded_value *value = record_value(recorder, RECORD_DOUBLE);
+    if (value != NULL)
+        value->double_value = data;
     return data;
 }
 
+recorded_value *record_find(data_recorder recorder, guint frame, record_slot slot, bool is_frame) {
+    for (guint index = recorder->frames[frame].last; index != 0; index = recorder->values[index].next) {
+        recorded_value *value = recorder->values + index;
+        if (value->slot == slot && (value->type == RECORD_FRAME) == is_frame)
+            return value;
+    }
+    return NULL;
+}
+
 void record_push(data_recorder recorder) {
-    if (recorder->recording == NULL)
+    record_slot slot = recorder->recording;
+    recorder->recording = RECORD_SLOT_NONE;
+    if (recorder->depth == recorder->stack_capacity) {
+        recorder->stack_capacity *= 2;
+        recorder->stack = g_renew(guint, recorder->stack, recorder->stack_capacity);
+        COUNT_DECODE_ALLOCATION();
+    }
+    recorder->stack[recorder->depth++] = recorder->current;
+    if (slot == RECORD_SLOT_SAME)
         return;
-    recorder->recording_path = g_strconcat(recorder->recording_path, "/", recorder->recording, NULL);
-    recorder->recording = NULL;
+    if (recorder->frame_count == recorder->frame_capacity) {
+        recorder->frame_capacity *= 2;
+        recorder->frames = g_renew(record_frame, recorder->frames, recorder->frame_capacity);
+        COUNT_DECODE_ALLOCATION();
+    }
+    guint frame = recorder->frame_count++;
+    recorder->frames[frame].parent = recorder->current;
+    recorder->frames[frame].last = 0;
+    if (slot != RECORD_SLOT_NONE)
+        record_add(recorder, slot, RECORD_FRAME)->frame = frame;
+    recorder->current = frame;
 }
 
 void record_pop(data_recorder recorder) {
-    guint index;
-    for (index = strlen(recorder->recording_path) - 1;; index--)
-        if (recorder->recording_path[index] == '/')
-            break;
-    recorder->recording_path[index] = '\0';
-    recorder->recording = NULL;
-}
-
-void *record_query(data_recorder recorder, gchar **path) {
-    gchar *recording_path = strdup(recorder->recording_path);
-    for (int i = 0; i < 10; i++) {
-        gchar *key = path[i];
-        if (key == NULL)
-            break;
-        gchar *alias = wmem_map_lookup(recorder->alias_map, key);
-        if (alias != NULL)
-            key = alias;
-        if (strcmp(key, "..") == 0) {
-            guint index;
-            for (index = strlen(recording_path) - 1;; index--)
-                if (recording_path[index] == '/')
-                    break;
-            recording_path[index] = '\0';
-        } else
-            recording_path = g_strconcat(recording_path, "/", key, NULL);
+    if (recorder->depth > 0)
+        recorder->current = recorder->stack[--recorder->depth];
+    recorder->recording = RECORD_SLOT_NONE;
+}
+
+record_slot record_resolve_alias(data_recorder recorder, record_slot slot) {
+    for (guint i = recorder->alias_count; i > 0; i--)
+        if (recorder->alias_names[i - 1] == slot)
+            return recorder->alias_slots[i - 1];
+    return slot;
+}
+
+recorded_value *record_query_value(data_recorder recorder, record_path path) {
+    guint frame = recorder->current;
+    for (guint i = 0; i < path->length; i++) {
+        record_slot slot = record_resolve_alias(recorder, path->slots[i]);
+        if (slot == RECORD_SLOT_PARENT) {
+            if (frame == 0)
+                return NULL;
+            frame = recorder->frames[frame].parent;
+        } else if (i == path->length - 1)
+            return record_find(recorder, frame, slot, false);
+        else {
+            recorded_value *child = record_find(recorder, frame, slot, true);
+            if (child == NULL)
+                return NULL;
+            frame = child->frame;
+        }
+    }
+    return NULL;
+}
+
+void *record_query(data_recorder recorder, record_path path) {
+    recorded_value *value = record_query_value(recorder, path);
+    if (value == NULL)
+        return "";
+    // Numbers are only formatted when something asks for their text
+    switch (value->type) {
+        case RECORD_POINTER:
+            return value->pointer == NULL ? "" : value->pointer;
+        case RECORD_BOOL:
+            return value->int_value == 0 ? "false" : "true";
+        case RECORD_UINT:
+            return wmem_strdup_printf(wmem_packet_scope(), "%u", (guint32) value->int_value);
+        case RECORD_UINT64:
+            return wmem_strdup_printf(wmem_packet_scope(), "%" G_GUINT64_FORMAT, value->uint_value);
+        case RECORD_INT:
+            return wmem_strdup_printf(wmem_packet_scope(), "%d", (gint32) value->int_value);
+        case RECORD_INT64:
+            return wmem_strdup_printf(wmem_packet_scope(), "%" G_GINT64_FORMAT, value->int_value);
+        case RECORD_FLOAT:
+            return wmem_strdup_printf(wmem_packet_scope(), "%f", value->double_value);
+        case RECORD_DOUBLE:
+            return wmem_strdup_printf(wmem_packet_scope(), "%lf", value->double_value);
+        default:
+            return "";
     }
-    void *data = wmem_map_lookup(recorder->store_map, recording_path);
-    g_free(recording_path);
-    return data == NULL ? "" : data;
 }
 
-gchar *record_get_recording(data_recorder recorder) {
+bool record_query_int(data_recorder recorder, record_path path, gint64 *result) {
+    recorded_value *value = record_query_value(recorder, path);
+    if (value == NULL)
+        return false;
+    switch (value->type) {
+        case RECORD_UINT:
+        case RECORD_INT:
+        case RECORD_INT64:
+            *result = value->int_value;
+            return true;
+        case RECORD_UINT64:
+            if (value->uint_value > G_MAXINT64)
+                return false;
+            *result = (gint64) value->uint_value;
+            return true;
+        default:
+            return false;
+    }
+}
+
+record_slot record_get_recording(data_recorder recorder) {
     return recorder->recording;
 }
 
-void record_add_alias(data_recorder recorder, gchar *name, gchar *alias) {
-    wmem_map_insert(recorder->alias_map, name, alias);
+void record_add_alias(data_recorder recorder, record_slot name, record_slot alias) {
+    if (recorder->alias_count == recorder->alias_capacity) {
+        recorder->alias_capacity *= 2;
+        recorder->alias_names = g_renew(record_slot, recorder->alias_names, recorder->alias_capacity);
+        recorder->alias_slots = g_renew(record_slot, recorder->alias_slots, recorder->alias_capacity);
+        COUNT_DECODE_ALLOCATION();
+    }
+    recorder->alias_names[recorder->alias_count] = name;
+    recorder->alias_slots[recorder->alias_count] = alias;
+    recorder->alias_count++;
 }
 
 void record_clear_alias(data_recorder recorder) {
-    wmem_free(wmem_packet_scope(), recorder->alias_map);
-    recorder->alias_map = wmem_map_new(wmem_packet_scope(), g_str_hash, g_str_equal);
-}
\ No newline at end of file
+    recorder->alias_count = 0;
+}
@@ -7,13 +7,58 @@
 
 #include <epan/proto.h>
 
+// Names are interned to slots when the schema is compiled, so recording and querying a value compares integers.
+// A recorder keeps its values in frames, one for every push, and reuses their storage for every packet.
+// Only slots that a compiled path can reach are recorded, starting any other slot is the same as RECORD_SLOT_NONE.
+// A recorder also holds the rest of the state of one decode, so compiled fields are never written while decoding.
+
+typedef guint record_slot;
+
+#define RECORD_SLOT_NONE 0          // values are not kept and pushed frames can't be queried, used for array elements
+#define RECORD_SLOT_SAME 1          // a push stays in the current frame, anonymous fields record into their parent
+#define RECORD_SLOT_PARENT 2        // ".."
+#define RECORD_SLOT_MAPPER_VALUE 3  // "__mapperValue"
+#define RECORD_SLOT_UNNAMED 4       // "[unnamed]"
+
+// A query path like "../type" with its names interned
+typedef struct {
+    gchar **source; // NULL terminated, kept to save the path
+    guint length;
+    record_slot *slots;
+} record_path_t, *record_path;
+
 typedef struct _data_recorder data_recorder_t, *data_recorder;
 
+// Slots and paths are only made with the schema lock held
+void init_data_recorder(wmem_allocator_t *allocator);
+
+record_slot record_intern(const gchar *name);
+
+// Marks a slot as read by queries, paths mark their own names
+void record_use(record_slot slot);
+
+record_path record_compile_path(wmem_allocator_t *allocator, gchar **source);
+
 data_recorder create_data_recorder();
 
 void destroy_data_recorder(data_recorder recorder);
 
-void record_start(data_recorder recorder, gchar *name);
+// Drops every value and alias, the storage is kept for the next packet
+void record_reset(data_recorder recorder);
+
+void record_start(data_recorder recorder, record_slot slot);
+
+// Starts an unrecorded array element whose subtree is labelled instead of using the display name of its field
+void record_start_element(data_recorder recorder, gchar *label);
+
+// Label of the subtree of the field being decoded, its display name if it was not started as an element.
+// The label is only used once.
+gchar *record_take_label(data_recorder recorder, gchar *display_name);
+
+// Shows the sub field under the label, or under the display name of the field passing it if there is none
+void record_pass_label(data_recorder recorder, gchar *display_name);
+
+void record_drop_label(data_recorder recorder);
 
 void *record(data_recorder recorder, void *data);
 
@@ -35,11 +80,15 @@ void record_push(data_recorder recorder);
 
 void record_pop(data_recorder recorder);
 
-void *record_query(data_recorder recorder, gchar **path);
+// Text of the value, numbers are formatted in the packet scope
+void *record_query(data_recorder recorder, record_path path);
+
+bool record_query_int(data_recorder recorder, record_path path, gint64 *result);
 
-gchar *record_get_recording(data_recorder recorder);
+// RECORD_SLOT_NONE if the started slot is not recorded
+record_slot record_get_recording(data_recorder recorder);
 
-void record_add_alias(data_recorder recorder, gchar *name, gchar *alias);
+void record_add_alias(data_recorder recorder, record_slot name, record_slot alias);
 
 void record_clear_alias(data_recorder recorder);
 
@@ -0,0 +1,368 @@
+#include "nbt.h"
+#include "protocol_data.h"
+#include "protocol_functions.h"
+#include "protocol_je/je_dissect.h"
+
+// NBT is walked with an explicit stack of the lists and compounds being read, so nesting uses no C stack.
+// Without a tree the walk only finds the length, and lists and arrays of fixed width values are skipped at once.
+// With a tree the walk lists the shown tags as nodes, which are made into tree items afterwards.
+// Large NBT is cached for the capture with its nodes, registries sent to every connection are listed once.
+
+typedef struct {
+    guint8 type;         // TAG_LIST or TAG_COMPOUND
+    guint8 element_type; // of a list
+    bool shown;          // whether the elements are shown
+    guint left;          // elements of a list not read yet
+    guint index;         // of the next element
+    const guint8 *start;
+    gint node;           // -1 if the tag is not shown
+    const guint8 *hidden_start; // first element not shown because of the element limit
+} nbt_frame;
+
+#define NBT_NODE_HIDDEN 0xFF // elements over the element limit
+
+#define NBT_NODE_ELEMENT 1   // the name is the index of a list element
+#define NBT_NODE_SUBTREE 2   // the elements of the list or compound are shown
+
+// A shown tag, offsets are from the start of the NBT
+typedef struct {
+    guint32 start;
+    guint32 length;
+    guint32 value;
+    guint32 name;        // offset of the name, or the index of a list element
+    guint32 count;       // elements or bytes of a string
+    guint16 name_length;
+    guint16 depth;       // of the tree the tag is in, 0 for the tree passed in
+    guint8 type;         // TAG_* or NBT_NODE_HIDDEN
+    guint8 element_type;
+    guint8 flags;
+} nbt_node;
+
+#define NBT_CACHE_MIN_LENGTH 256           // shorter NBT is walked faster than it is looked up
+#define NBT_CACHE_MAX_SIZE (64 * 1024 * 1024) // bytes and nodes kept for a capture, later NBT is not cached
+
+// Entries with the same hash are chained and told apart by their bytes
+typedef struct _nbt_cache_entry {
+    const guint8 *bytes;
+    guint length;
+    gint type;
+    nbt_node *nodes;
+    guint node_count;
+    guint depth_limit;   // limits the nodes were made with
+    guint shown_elements;
+    struct _nbt_cache_entry *next;
+} nbt_cache_entry;
+
+wmem_map_t *nbt_cache; // hash -> nbt_cache_entry, cleared with the capture
+guint64 nbt_cache_size;
+GMutex nbt_cache_mutex;
+
+const gchar *NBT_TYPE_NAMES[] = {"End", "Byte", "Short", "Int", "Long", "Float", "Double", "Byte Array", "String",
+                                 "List", "Compound", "Int Array", "Long Array"};
+
+guint nbt_depth_limit = 0;
+
+void set_nbt_depth_limit(guint limit) {
+    nbt_depth_limit = limit;
+}
+
+// 0 if the length of the value is in the data
+guint nbt_fixed_width(guint type) {
+    switch (type) {
+        case TAG_BYTE:
+            return 1;
+        case TAG_SHORT:
+            return 2;
+        case TAG_INT:
+        case TAG_FLOAT:
+            return 4;
+        case TAG_LONG:
+        case TAG_DOUBLE:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+gchar *nbt_value_text(tvbuff_t *tvb, guint offset, const guint8 *value, guint type, guint count) {
+    wmem_allocator_t *scope = wmem_packet_scope();
+    switch (type) {
+        case TAG_END:
+            return "";
+        case TAG_BYTE:
+            return wmem_strdup_printf(scope, "%d", (gint8) value[0]);
+        case TAG_SHORT:
+            return wmem_strdup_printf(scope, "%d", (gint16) peek_u16(value));
+        case TAG_INT:
+            return wmem_strdup_printf(scope, "%d", (gint32) peek_u32(value));
+        case TAG_LONG:
+            return wmem_strdup_printf(scope, "%" G_GINT64_FORMAT, (gint64) peek_u64(value));
+        case TAG_FLOAT:
+            return wmem_strdup_printf(scope, "%g", peek_f32(value));
+        case TAG_DOUBLE:
+            return wmem_strdup_printf(scope, "%g", peek_f64(value));
+        case TAG_STRING:
+            return wmem_strdup_printf(scope, "\"%s\"", tvb_get_string_enc(scope, tvb, offset + 2, count, ENC_UTF_8));
+        default:
+            return wmem_strdup_printf(scope, "%u elements", count);
+    }
+}
+
+void add_nbt_node(wmem_array_t *nodes, const guint8 *data, const guint8 *start, guint length, const guint8 *value,
+                  guint name, guint name_length, guint count, guint depth, guint type, guint element_type,
+                  guint flags) {
+    nbt_node node = {
+            (guint32) (start - data), length, (guint32) (value - data), name, count, (guint16) name_length,
+            (guint16) depth, (guint8) type, (guint8) element_type, (guint8) flags
+    };
+    wmem_array_append_one(nodes, node);
+}
+
+void finish_nbt_frame(wmem_array_t *nodes, nbt_frame *frame, guint depth, const guint8 *end, const guint8 *data,
+                      guint shown_elements) {
+    if (frame->node < 0)
+        return;
+    ((nbt_node *) wmem_array_index(nodes, frame->node))->length = (guint32) (end - frame->start);
+    if (frame->hidden_start != NULL) {
+        const guint8 *hidden_end = frame->type == TAG_COMPOUND ? end - 1 : end;
+        add_nbt_node(nodes, data, frame->hidden_start, (guint) (hidden_end - frame->hidden_start),
+                     frame->hidden_start, 0, 0, frame->index - shown_elements, depth, NBT_NODE_HIDDEN, TAG_END, 0);
+    }
+}
+
+// Lists the shown tags into nodes if it is not NULL
+gint walk_nbt(const guint8 *data, guint max_length, gint root_type, wmem_array_t *nodes, guint shown_elements) {
+    data_slice slice = make_slice(data, max_length);
+    nbt_frame stack[NBT_MAX_DEPTH];
+    guint depth = 0;
+    bool shown = nodes != NULL;
+    const guint8 *tag_start = slice.now;
+    guint name = 0, name_length = 0, flags = 0;
+    guint type = root_type;
+    if (root_type == NBT_NAMED_ROOT) {
+        type = slice_u8(&slice);
+        name_length = slice_u16(&slice);
+        name = 3;
+        slice_skip(&slice, name_length);
+    }
+    while (true) {
+        // Value of the tag starting at tag_start
+        const guint8 *value = slice.now;
+        guint width = nbt_fixed_width(type);
+        guint count = 0;
+        if (type == TAG_LIST || type == TAG_COMPOUND) {
+            guint8 element_type = TAG_END;
+            if (type == TAG_LIST) {
+                element_type = slice_u8(&slice);
+                count = slice_u32(&slice);
+                if (element_type == TAG_END && count != 0) // the game can't read it either
+                    slice_fail(&slice);
+            }
+            if (type == TAG_LIST && !shown && (element_type == TAG_END || nbt_fixed_width(element_type) != 0))
+                slice_skip(&slice, (guint64) count * nbt_fixed_width(element_type));
+            else if (depth == NBT_MAX_DEPTH)
+                slice_fail(&slice);
+            else if (!slice.failed) {
+                nbt_frame *frame = stack + depth++;
+                frame->type = type;
+                frame->element_type = element_type;
+                frame->shown = shown && depth <= nbt_depth_limit;
+                frame->left = count;
+                frame->index = 0;
+                frame->start = tag_start;
+                frame->node = -1;
+                frame->hidden_start = NULL;
+                if (shown) {
+                    frame->node = (gint) wmem_array_get_count(nodes);
+                    add_nbt_node(nodes, data, tag_start, 0, value, name, name_length, count, depth - 1, type,
+                                 element_type, flags | (frame->shown ? NBT_NODE_SUBTREE : 0));
+                }
+            }
+        } else if (width != 0 || type == TAG_END) {
+            slice_skip(&slice, width);
+        } else if (type == TAG_STRING) {
+            count = slice_u16(&slice);
+            slice_skip(&slice, count);
+        } else if (type == TAG_BYTE_ARRAY || type == TAG_INT_ARRAY || type == TAG_LONG_ARRAY) {
+            count = slice_u32(&slice);
+            slice_skip(&slice, (guint64) count * (type == TAG_BYTE_ARRAY ? 1 : type == TAG_INT_ARRAY ? 4 : 8));
+        } else
+            slice_fail(&slice);
+        if (slice.failed)
+            return INVALID_DATA;
+        if (shown && type != TAG_LIST && type != TAG_COMPOUND)
+            add_nbt_node(nodes, data, tag_start, (guint) (slice.now - tag_start), value, name, name_length, count,
+                         depth, type, TAG_END, flags);
+
+        // Next tag, leaving the lists and compounds that are done
+        nbt_frame *frame;
+        while (true) {
+            if (depth == 0)
+                return (gint) (slice.now - data);
+            frame = stack + depth - 1;
+            tag_start = slice.now;
+            if (frame->type == TAG_COMPOUND) {
+                type = slice_u8(&slice);
+                if (slice.failed)
+                    return INVALID_DATA;
+                if (type != TAG_END)
+                    break;
+            } else if (frame->left > 0) {
+                frame->left--;
+                type = frame->element_type;
+                break;
+            }
+            finish_nbt_frame(nodes, frame, depth, slice.now, data, shown_elements);
+            depth--;
+        }
+        if (frame->shown && frame->hidden_start == NULL && frame->index == shown_elements)
+            frame->hidden_start = tag_start;
+        shown = frame->shown && frame->hidden_start == NULL;
+        if (frame->type == TAG_COMPOUND) {
+            name_length = slice_u16(&slice);
+            name = (guint) (slice.now - data);
+            flags = 0;
+            slice_skip(&slice, name_length);
+            if (slice.failed)
+                return INVALID_DATA;
+        } else {
+            name = frame->index;
+            name_length = 0;
+            flags = NBT_NODE_ELEMENT;
+        }
+        frame->index++;
+    }
+}
+
+void add_nbt_nodes(proto_tree *tree, tvbuff_t *tvb, const guint8 *data, guint offset, const nbt_node *nodes,
+                   guint node_count) {
+    proto_tree *trees[NBT_MAX_DEPTH + 1];
+    trees[0] = tree;
+    for (guint i = 0; i < node_count; i++) {
+        const nbt_node *node = nodes + i;
+        proto_tree *parent = trees[node->depth];
+        if (node->type == NBT_NODE_HIDDEN) {
+            add_hidden_elements(parent, tvb, node->count, offset + node->start, node->length, true);
+            continue;
+        }
+        const gchar *name = "";
+        if (node->flags & NBT_NODE_ELEMENT)
+            name = get_element_label(node->name);
+        else if (node->name_length > 0)
+            name = (gchar *) tvb_get_string_enc(wmem_packet_scope(), tvb, (gint) (offset + node->name),
+                                                node->name_length, ENC_UTF_8);
+        if (node->type == TAG_LIST || node->type == TAG_COMPOUND) {
+            proto_item *item = node->type == TAG_LIST && node->element_type <= TAG_LONG_ARRAY ?
+                               proto_tree_add_string_format_value(
+                                       parent, hf_nbt_tag_je, tvb, offset + node->start, node->length, name,
+                                       "%s (List of %u %s)", name, node->count, NBT_TYPE_NAMES[node->element_type]) :
+                               proto_tree_add_string_format_value(
+                                       parent, hf_nbt_tag_je, tvb, offset + node->start, node->length, name,
+                                       "%s (%s)", name, NBT_TYPE_NAMES[node->type]);
+            if (node->flags & NBT_NODE_SUBTREE)
+                trees[node->depth + 1] = proto_item_add_subtree(item, ett_sub_je);
+        } else
+            proto_tree_add_string_format_value(parent, hf_nbt_tag_je, tvb, offset + node->start, node->length, name,
+                                               "%s (%s): %s", name, NBT_TYPE_NAMES[node->type],
+                                               nbt_value_text(tvb, offset + node->value, data + node->value,
+                                                              node->type, node->count));
+    }
+}
+
+guint hash_nbt(const guint8 *data, guint length) {
+    guint64 hash = 0xcbf29ce484222325;
+    guint i = 0;
+    for (; i + 8 <= length; i += 8)
+        hash = (hash ^ peek_u64(data + i)) * 0x100000001b3;
+    for (; i < length; i++)
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    return (guint) (hash ^ hash >> 32);
+}
+
+gboolean reset_nbt_cache_size(wmem_allocator_t *allocator _U_, wmem_cb_event_t event _U_, void *user_data _U_) {
+    nbt_cache_size = 0;
+    return TRUE;
+}
+
+nbt_cache_entry *find_nbt_cache_entry(guint hash, const guint8 *data, guint length, gint type) {
+    if (nbt_cache == NULL) {
+        nbt_cache = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(), g_direct_hash, g_direct_equal);
+        wmem_register_callback(wmem_file_scope(), reset_nbt_cache_size, NULL);
+        COUNT_DECODE_ALLOCATION();
+    }
+    nbt_cache_entry *entry = wmem_map_lookup(nbt_cache, GUINT_TO_POINTER(hash));
+    while (entry != NULL && (entry->type != type || entry->length != length || memcmp(entry->bytes, data, length) != 0))
+        entry = entry->next;
+    return entry;
+}
+
+// Length of the NBT and the nodes of its shown tags, which are in the packet or the capture scope.
+// Large NBT is looked up by its own bytes, so the same NBT is only listed once for the capture.
+gint list_nbt_nodes(const guint8 *data, guint max_length, gint type, const nbt_node **nodes, guint *node_count) {
+    gint length = walk_nbt(data, max_length, type, NULL, 0);
+    if (is_invalid(length))
+        return length;
+    guint shown_elements = get_shown_element_count(G_MAXUINT);
+    bool cached = length >= NBT_CACHE_MIN_LENGTH;
+    guint hash = cached ? hash_nbt(data, length) : 0;
+    if (cached) {
+        g_mutex_lock(&nbt_cache_mutex);
+        nbt_cache_entry *entry = find_nbt_cache_entry(hash, data, length, type);
+        bool found = entry != NULL && entry->depth_limit == nbt_depth_limit &&
+                     entry->shown_elements == shown_elements;
+        if (found) {
+            *nodes = entry->nodes;
+            *node_count = entry->node_count;
+        }
+        g_mutex_unlock(&nbt_cache_mutex);
+        if (found)
+            return length;
+    }
+
+    wmem_array_t *array = wmem_array_sized_new(wmem_packet_scope(), sizeof(nbt_node), 64);
+    walk_nbt(data, length, type, array, shown_elements);
+    *nodes = wmem_array_get_raw(array);
+    *node_count = wmem_array_get_count(array);
+    if (cached) {
+        g_mutex_lock(&nbt_cache_mutex);
+        nbt_cache_entry *entry = find_nbt_cache_entry(hash, data, length, type);
+        guint64 size = (guint64) *node_count * sizeof(nbt_node) + (entry == NULL ? length : 0);
+        if (nbt_cache_size + size <= NBT_CACHE_MAX_SIZE) {
+            if (entry == NULL) {
+                entry = wmem_new0(wmem_file_scope(), nbt_cache_entry);
+                entry->bytes = wmem_memdup(wmem_file_scope(), data, length);
+                entry->length = length;
+                entry->type = type;
+                entry->next = wmem_map_lookup(nbt_cache, GUINT_TO_POINTER(hash));
+                wmem_map_insert(nbt_cache, GUINT_TO_POINTER(hash), entry);
+            }
+            entry->nodes = wmem_memdup(wmem_file_scope(), *nodes, *node_count * sizeof(nbt_node));
+            entry->node_count = *node_count;
+            entry->depth_limit = nbt_depth_limit;
+            entry->shown_elements = shown_elements;
+            nbt_cache_size += size;
+            COUNT_DECODE_ALLOCATION();
+        }
+        g_mutex_unlock(&nbt_cache_mutex);
+    }
+    return length;
+}
+
+gint count_nbt_length_with_type(const guint8 *data, guint max_length, guint type) {
+    return walk_nbt(data, max_length, (gint) type, NULL, 0);
+}
+
+gint count_nbt_length(const guint8 *data, guint max_length) {
+    return walk_nbt(data, max_length, NBT_NAMED_ROOT, NULL, 0);
+}
+
+gint add_nbt_tree(proto_tree *tree, tvbuff_t *tvb, const guint8 *data, guint offset, guint max_length, gint type) {
+    if (nbt_depth_limit == 0)
+        return walk_nbt(data, max_length, type, NULL, 0);
+    const nbt_node *nodes;
+    guint node_count;
+    gint length = list_nbt_nodes(data, max_length, type, &nodes, &node_count);
+    if (length != INVALID_DATA)
+        add_nbt_nodes(tree, tvb, data, offset, nodes, node_count);
+    return length;
+}
@@ -0,0 +1,38 @@
+#ifndef MC_DISSECTOR_NBT_H
+#define MC_DISSECTOR_NBT_H
+
+#include <epan/proto.h>
+
+#define TAG_END        0
+#define TAG_BYTE       1
+#define TAG_SHORT      2
+#define TAG_INT        3
+#define TAG_LONG       4
+#define TAG_FLOAT      5
+#define TAG_DOUBLE     6
+#define TAG_BYTE_ARRAY 7
+#define TAG_STRING     8
+#define TAG_LIST       9
+#define TAG_COMPOUND   10
+#define TAG_INT_ARRAY  11
+#define TAG_LONG_ARRAY 12
+
+// Same limit as the game, deeper NBT is malformed
+#define NBT_MAX_DEPTH 512
+
+// Passed as the type of NBT that starts with the type and name of its root tag
+#define NBT_NAMED_ROOT (-1)
+
+// Length of an NBT value of the type or of a named root tag, INVALID_DATA if it is malformed or longer than max_length
+gint count_nbt_length_with_type(const guint8 *data, guint max_length, guint type);
+
+gint count_nbt_length(const guint8 *data, guint max_length);
+
+// Tags nested deeper than the limit are not shown, 0 only shows the bytes
+void set_nbt_depth_limit(guint limit);
+
+// Shows the tags of the NBT at the offset of the tvb, data points to the same byte. Lists and compounds show as many
+// elements as arrays do. Returns the length like count_nbt_length.
+gint add_nbt_tree(proto_tree *tree, tvbuff_t *tvb, const guint8 *data, guint offset, guint max_length, gint type);
+
+#endif //MC_DISSECTOR_NBT_H
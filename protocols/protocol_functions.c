@@ -9,8 +9,22 @@
 #include "resources.h"
 #include "protocol_functions.h"
 
-wmem_map_t *entity_hierarchy;
+wmem_map_t *entity_hierarchy; // entity -> NULL terminated types from the root
 wmem_map_t *entity_ids;
+GMutex entity_ids_mutex; // tables are made on first use by any decoding thread
+wmem_map_t *sync_entity_data; // type -> GPtrArray of sync_data_entry
+
+// A synced data name, usable from every flag that is positive up to the version and every other one after
+typedef struct {
+    gchar *name;
+    guint flag_count;
+    gint *flags;
+} sync_data_entry;
+
+record_path entity_id_path;
+record_path type_path;
+record_path parent_entity_id_path;
+record_path key_path;
 
 void init_entity_hierarchy() {
     entity_hierarchy = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
@@ -31,7 +45,7 @@ void init_entity_hierarchy() {
             wmem_list_append(path_array, GUINT_TO_POINTER(strlen(path)));
         else {
             path = g_strconcat(g_strndup(path, last_index), "/", now, NULL);
-            wmem_map_insert(entity_hierarchy, g_strdup(now), g_strdup(path + 1));
+            wmem_map_insert(entity_hierarchy, g_strdup(now), g_strsplit(path + 1, "/", 1000));
         }
     }
     wmem_destroy_list(path_array);
@@ -43,7 +57,7 @@ wmem_map_t *init_entity_ids(guint data_version) {
     int desc_counts = atoi(lines[0]);
     char **descs = g_strsplit(lines[1], " ", desc_counts);
     int versions = atoi(lines[2]);
-    for (int i = versions - 1; i >= 0; i++) {
+    for (int i = versions - 1; i >= 0; i--) {
         char **version_data = g_strsplit(lines[3 + i * 2], " ", 2);
         int version_now = atoi(version_data[0]);
         if (version_now <= data_version) {
@@ -69,80 +83,107 @@ wmem_map_t *init_entity_ids(guint data_version) {
     return wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
 }
 
+void init_sync_entity_data() {
+    sync_entity_data = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
+    char **split = g_strsplit(RESOURCE_SYNC_ENTITY_DATA, "\n", 1000);
+    for (int i = 0; split[i * 2] != NULL && split[i * 2 + 1] != NULL; i++) {
+        GPtrArray *entries = wmem_map_lookup(sync_entity_data, split[i * 2]);
+        if (entries == NULL) {
+            entries = g_ptr_array_new();
+            wmem_map_insert(sync_entity_data, wmem_strdup(wmem_epan_scope(), split[i * 2]), entries);
+        }
+        char **split_entries = g_strsplit(split[i * 2 + 1], ",", 1000);
+        for (int j = 0; split_entries[j] != NULL; j++) {
+            char **split_entry = g_strsplit(split_entries[j], " ", 10);
+            guint length = g_strv_length(split_entry);
+            sync_data_entry *entry = wmem_new(wmem_epan_scope(), sync_data_entry);
+            entry->name = wmem_strdup(wmem_epan_scope(), split_entry[0]);
+            entry->flag_count = length > 0 ? length - 1 : 0;
+            entry->flags = wmem_alloc_array(wmem_epan_scope(), gint, entry->flag_count);
+            for (guint flag_index = 0; flag_index < entry->flag_count; flag_index++)
+                entry->flags[flag_index] = atoi(split_entry[flag_index + 1]);
+            g_ptr_array_add(entries, entry);
+            g_strfreev(split_entry);
+        }
+        g_strfreev(split_entries);
+    }
+    g_strfreev(split);
+}
+
 void init_protocol_functions() {
     init_entity_hierarchy();
+    init_sync_entity_data();
     entity_ids = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
+    entity_id_path = record_compile_path(wmem_epan_scope(), g_strsplit("entityId", "/", 10));
+    type_path = record_compile_path(wmem_epan_scope(), g_strsplit("type", "/", 10));
+    parent_entity_id_path = record_compile_path(wmem_epan_scope(), g_strsplit("../entityId", "/", 10));
+    key_path = record_compile_path(wmem_epan_scope(), g_strsplit("key", "/", 10));
 }
 
-FIELD_MAKE_TREE(record_entity_id) {
+wmem_map_t *get_entity_id_record(extra_data *extra) {
     wmem_map_t *entity_id_record = wmem_map_lookup(extra->data, "entity_id_record");
     if (entity_id_record == NULL) {
         entity_id_record = wmem_map_new(wmem_file_scope(), g_str_hash, g_str_equal);
         wmem_map_insert(extra->data, "entity_id_record", entity_id_record);
+        COUNT_DECODE_ALLOCATION();
     }
-    char *id_path[] = {"entityId", NULL};
-    gchar *id = record_query(recorder, id_path);
-    char *type_path[] = {"type", NULL};
+    return entity_id_record;
+}
+
+// The id is only copied the first time it is seen, a packet seen again replaces the type in place
+void record_entity_type(wmem_map_t *entity_id_record, gchar *id, gchar *type) {
+    if (!wmem_map_contains(entity_id_record, id)) {
+        id = wmem_strdup(wmem_file_scope(), id);
+        COUNT_DECODE_ALLOCATION();
+    }
+    wmem_map_insert(entity_id_record, id, type);
+}
+
+FIELD_MAKE_TREE(record_entity_id) {
+    wmem_map_t *entity_id_record = get_entity_id_record(extra);
+    gchar *id = record_query(recorder, entity_id_path);
     gchar *type = record_query(recorder, type_path);
+    g_mutex_lock(&entity_ids_mutex);
     wmem_map_t *entity_id_data = wmem_map_lookup(entity_ids, wmem_map_lookup(extra->data, "data_version"));
     if (entity_id_data == NULL) {
         entity_id_data = init_entity_ids(GPOINTER_TO_UINT(wmem_map_lookup(extra->data, "data_version")));
-        wmem_map_insert(entity_ids, type, entity_id_data);
+        COUNT_DECODE_ALLOCATION();
+        wmem_map_insert(entity_ids, wmem_map_lookup(extra->data, "data_version"), entity_id_data);
     }
+    g_mutex_unlock(&entity_ids_mutex);
     char *str_type = wmem_map_lookup(entity_id_data, type);
-    wmem_map_insert(entity_id_record, id, str_type);
+    record_entity_type(entity_id_record, id, str_type);
     if (tree)
         proto_tree_add_string(tree, get_string_je("entity_type_name", "string"), tvb, 0, 0, str_type);
     return 0;
 }
 
 FIELD_MAKE_TREE(record_entity_id_player) {
-    wmem_map_t *entity_id_record = wmem_map_lookup(extra->data, "entity_id_record");
-    if (entity_id_record == NULL) {
-        entity_id_record = wmem_map_new(wmem_file_scope(), g_str_hash, g_str_equal);
-        wmem_map_insert(extra->data, "entity_id_record", entity_id_record);
-    }
-    char *id_path[] = {"entityId", NULL};
-    gchar *id = record_query(recorder, id_path);
-    wmem_map_insert(entity_id_record, id, "player");
+    wmem_map_t *entity_id_record = get_entity_id_record(extra);
+    gchar *id = record_query(recorder, entity_id_path);
+    record_entity_type(entity_id_record, id, "player");
     return 0;
 }
 
 FIELD_MAKE_TREE(record_entity_id_experience_orb) {
-    wmem_map_t *entity_id_record = wmem_map_lookup(extra->data, "entity_id_record");
-    if (entity_id_record == NULL) {
-        entity_id_record = wmem_map_new(wmem_file_scope(), g_str_hash, g_str_equal);
-        wmem_map_insert(extra->data, "entity_id_record", entity_id_record);
-    }
-    char *id_path[] = {"entityId", NULL};
-    gchar *id = record_query(recorder, id_path);
-    wmem_map_insert(entity_id_record, id, "experience_orb");
+    wmem_map_t *entity_id_record = get_entity_id_record(extra);
+    gchar *id = record_query(recorder, entity_id_path);
+    record_entity_type(entity_id_record, id, "experience_orb");
     return 0;
 }
 
 FIELD_MAKE_TREE(record_entity_id_painting) {
-    wmem_map_t *entity_id_record = wmem_map_lookup(extra->data, "entity_id_record");
-    if (entity_id_record == NULL) {
-        entity_id_record = wmem_map_new(wmem_file_scope(), g_str_hash, g_str_equal);
-        wmem_map_insert(extra->data, "entity_id_record", entity_id_record);
-    }
-    char *id_path[] = {"entityId", NULL};
-    gchar *id = record_query(recorder, id_path);
-    wmem_map_insert(entity_id_record, id, "painting");
+    wmem_map_t *entity_id_record = get_entity_id_record(extra);
+    gchar *id = record_query(recorder, entity_id_path);
+    record_entity_type(entity_id_record, id, "painting");
     return 0;
 }
 
 FIELD_MAKE_TREE(sync_entity_data) {
     if (!tree)
         return 0;
-    wmem_map_t *entity_id_record = wmem_map_lookup(extra->data, "entity_id_record");
-    if (entity_id_record == NULL) {
-        entity_id_record = wmem_map_new(wmem_file_scope(), g_str_hash, g_str_equal);
-        wmem_map_insert(extra->data, "entity_id_record", entity_id_record);
-    }
-    char *id_path[] = {"..", "entityId", NULL};
-    gchar *id = record_query(recorder, id_path);
-    char *key_path[] = {"key", NULL};
+    wmem_map_t *entity_id_record = get_entity_id_record(extra);
+    gchar *id = record_query(recorder, parent_entity_id_path);
     gchar *key = record_query(recorder, key_path);
     guint data_version = GPOINTER_TO_UINT(wmem_map_lookup(extra->data, "data_version"));
     guint key_int = atoi(key);
@@ -153,48 +194,32 @@ FIELD_MAKE_TREE(sync_entity_data) {
         proto_tree_add_string(tree, get_string_je("entity_type_name", "string"), tvb, 0, 0, "Unknown");
         return 0;
     }
-    char *hierarchy = wmem_map_lookup(entity_hierarchy, type);
-    if (hierarchy == NULL)
-        hierarchy = "";
-    char **split = g_strsplit(hierarchy, "/", 1000);
-    char **split_sync_data = g_strsplit(RESOURCE_SYNC_ENTITY_DATA, "\n", 1000);
+    char **hierarchy = wmem_map_lookup(entity_hierarchy, type);
     char *found_name = NULL;
-    for (int now = 0; split[now] != NULL && found_name == NULL; now++) {
-        char *now_type = split[now];
-        for (int i = 0; split_sync_data[i * 2] != NULL && found_name == NULL; i++) {
-            if (strcmp(now_type, split_sync_data[i * 2]) == 0) {
-                char *sync_data = split_sync_data[i * 2 + 1];
-                char **split_sync_data_now = g_strsplit(sync_data, ",", 1000);
-                for (int j = 0; split_sync_data_now[j] != NULL; j++) {
-                    char *entry = split_sync_data_now[j];
-                    char **split_entry = g_strsplit(entry, " ", 10);
-                    bool flag = true;
-                    for (int flag_index = 1; split_entry[flag_index] != NULL; flag_index++) {
-                        int flag_now = atoi(split_entry[flag_index]);
-                        if (flag_now > 0) {
-                            if (flag_now > data_version)
-                                flag = false;
-                        } else {
-                            if (-flag_now < data_version)
-                                flag = false;
-                        }
-                    }
-                    if (flag) {
-                        if (key_int == 0) {
-                            found_name = g_strdup(split_entry[0]);
-                            g_strfreev(split_entry);
-                            break;
-                        } else
-                            key_int--;
-                    }
-                    g_strfreev(split_entry);
+    for (int now = 0; hierarchy != NULL && hierarchy[now] != NULL && found_name == NULL; now++) {
+        GPtrArray *entries = wmem_map_lookup(sync_entity_data, hierarchy[now]);
+        for (guint i = 0; entries != NULL && i < entries->len; i++) {
+            sync_data_entry *entry = g_ptr_array_index(entries, i);
+            bool flag = true;
+            for (guint flag_index = 0; flag_index < entry->flag_count; flag_index++) {
+                int flag_now = entry->flags[flag_index];
+                if (flag_now > 0) {
+                    if (flag_now > data_version)
+                        flag = false;
+                } else {
+                    if (-flag_now < data_version)
+                        flag = false;
                 }
-                g_strfreev(split_sync_data_now);
+            }
+            if (flag) {
+                if (key_int == 0) {
+                    found_name = entry->name;
+                    break;
+                } else
+                    key_int--;
             }
         }
     }
-    g_strfreev(split);
-    g_strfreev(split_sync_data);
     if (found_name == NULL)
         found_name = "Unknown Sync Data!";
     proto_tree_add_string(tree, get_string_je("sync_entity_data", "string"), tvb, 0, 0, found_name);
@@ -6,18 +6,32 @@
 #ifndef MC_DISSECTOR_PROTOCOL_FUNCTIONS_H
 #define MC_DISSECTOR_PROTOCOL_FUNCTIONS_H
 
+#include <epan/exceptions.h>
 #include "protocol_schema.h"
 
+// Every field returns at most the remaining length. Data that doesn't fit is thrown like a tvb read past its end, so
+// Wireshark stops decoding and marks the packet as malformed with its expert item.
+#define CHECK_LENGTH(length) if ((length) > remaining) THROW(ReportedBoundsError);
+
+#define CHECK_READ(read) if (is_invalid(read)) THROW(ReportedBoundsError);
+
+// Counts taken from other fields may be negative or wider than a guint
+#define CHECK_COUNT(count) if ((count) < 0 || (count) > G_MAXUINT) THROW(ReportedBoundsError);
+
+// Most bytes kept in the value of a bytes item
+#define BYTES_MAX_LENGTH 200
+
 #define FIELD_MAKE_TREE(name) \
     guint make_tree_##name(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra, \
     protocol_field field, guint offset, guint remaining, data_recorder recorder)
 
 #define SINGLE_LENGTH_FIELD_MAKE(name, len, func_add, func_parse, record) \
     FIELD_MAKE_TREE(name) {                                               \
+        CHECK_LENGTH(len)                                                 \
         if (tree)                                                         \
-            func_add(tree, field->hf_index, tvb, offset, len, record(recorder, func_parse(tvb, offset))); \
+            func_add(tree, field->hf_index, tvb, offset, len, record(recorder, func_parse(data + offset))); \
         else                                                              \
-            record(recorder, func_parse(tvb, offset));                    \
+            record(recorder, func_parse(data + offset));                  \
         return len;                                                       \
     }
 
@@ -33,6 +47,105 @@ FIELD_MAKE_TREE(be_##name) { \
 guint make_tree_##name(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,\
     protocol_field field, guint offset, guint remaining, data_recorder recorder, bool is_je)
 
+// Native fields in protocol_schema.c, referenced by generated decoders, the bytecode compiler and the schema cache
+
+FIELD_MAKE_TREE(var_int);
+
+FIELD_MAKE_TREE(var_long);
+
+FIELD_MAKE_TREE(string);
+
+FIELD_MAKE_TREE(u8);
+
+FIELD_MAKE_TREE(u16);
+
+FIELD_MAKE_TREE(u32);
+
+FIELD_MAKE_TREE(u64);
+
+FIELD_MAKE_TREE(i8);
+
+FIELD_MAKE_TREE(i16);
+
+FIELD_MAKE_TREE(i32);
+
+FIELD_MAKE_TREE(i64);
+
+FIELD_MAKE_TREE(boolean);
+
+FIELD_MAKE_TREE(f32);
+
+FIELD_MAKE_TREE(f64);
+
+FIELD_MAKE_TREE(uuid);
+
+FIELD_MAKE_TREE(rest_buffer);
+
+FIELD_MAKE_TREE(void);
+
+FIELD_MAKE_TREE(nbt);
+
+FIELD_MAKE_TREE(optional_nbt);
+
+FIELD_MAKE_TREE(nbt_any_type);
+
+FIELD_MAKE_TREE(var_buffer);
+
+FIELD_MAKE_TREE(buffer);
+
+FIELD_MAKE_TREE(option);
+
+FIELD_MAKE_TREE(mapper);
+
+FIELD_MAKE_TREE(bitfield);
+
+FIELD_MAKE_TREE(switch);
+
+FIELD_MAKE_TREE(basic_type);
+
+FIELD_MAKE_TREE(je_container);
+
+FIELD_MAKE_TREE(be_container);
+
+FIELD_MAKE_TREE(je_array);
+
+FIELD_MAKE_TREE(be_array);
+
+FIELD_MAKE_TREE(je_top_bit_set_terminated_array);
+
+FIELD_MAKE_TREE(be_top_bit_set_terminated_array);
+
+FIELD_MAKE_TREE(je_entity_metadata_loop);
+
+FIELD_MAKE_TREE(be_entity_metadata_loop);
+
+// Chunk data of map_chunk in chunk_data.c, a VarInt prefixed buffer of chunk sections
+FIELD_MAKE_TREE(chunk_data);
+
+// Chunk data since 1.21.5, the count of longs in a paletted container follows from its bits per entry
+FIELD_MAKE_TREE(unprefixed_chunk_data);
+
+// Returns the field a switch decodes with, NULL if no case matched and there is no default
+protocol_field select_switch_case(protocol_field field, data_recorder recorder);
+
+// Bytes of the field if it is a native number or UUID, 0 if its size depends on the data
+guint get_fixed_width(protocol_field field);
+
+// Number of the elements shown from the start of an array
+guint get_shown_element_count(guint count);
+
+// One item for the elements after the shown ones
+void add_hidden_elements(proto_tree *tree, tvbuff_t *tvb, guint count, guint offset, guint length, bool is_je);
+
+// Elements of an array whose width is fixed, checked against the remaining bytes once.
+// They are shown under one data item and not recorded, returns INVALID_DATA if they don't fit.
+gint make_tree_fixed_width_elements(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                                    protocol_field field, guint offset, guint remaining, guint count,
+                                    data_recorder recorder, bool is_je);
+
+// Fills the integer lookup of cases sorted by key
+void build_int_cases(protocol_int_cases *int_cases, protocol_case *cases, guint size);
+
 #ifdef MC_DISSECTOR_FUNCTION_FEATURE
 
 void init_protocol_functions();
@@ -3,31 +3,314 @@
 //
 
 #include <stdlib.h>
+#include <epan/exceptions.h>
 #include "protocol_schema.h"
 #include "protocol_data.h"
 #include "protocol_je/je_dissect.h"
 #include "protocol_be/be_dissect.h"
 #include "protocol_functions.h"
+#include "protocol_vm.h"
+#include "schema_cache.h"
+#include "mc_dissector.h"
 
-#define BYTES_MAX_LENGTH 200
+#ifdef MC_DISSECTOR_AOT_DECODERS
+#include "aot_decoder.h"
+#endif // MC_DISSECTOR_AOT_DECODERS
+
+#define DENSE_CASE_MAX_RANGE 1024
+
+// Packets of one direction, ids are small and dense so entries are indexed by id directly
+typedef struct {
+    guint size;
+    protocol_entry *entries; // NULL for unused ids
+    wmem_map_t *name_map;    // name -> id + 1
+} protocol_packets;
 
 struct _protocol_set {
-    wmem_map_t *client_packet_map;
-    wmem_map_t *server_packet_map;
-    wmem_map_t *client_name_map;
-    wmem_map_t *server_name_map;
+    protocol_packets client_packets;
+    protocol_packets server_packets;
+    gchar *name;
+    bool changed; // packets were compiled since its cache was loaded or saved
 };
 
 struct _protocol_entry {
     guint id;
     gchar *name;
     protocol_field field;
+    guint (*make_tree)(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                       protocol_field field, guint offset, guint remaining, data_recorder recorder);
+    vm_program program; // used instead of make_tree if not NULL
+#ifdef MC_DISSECTOR_AOT_DECODERS
+    gchar *aot_name;
+#endif // MC_DISSECTOR_AOT_DECODERS
+
+    // Raw definition, compiled into field on the first lookup or by the warm-up thread
+    gint compiled;
+    schema_node definition;
+    schema_node types;
+    bool is_je;
+    protocol_settings settings;
 };
 
+// Compiled schemas can be built by the warm-up thread, so they live in their own allocator and are only touched with
+// the schema lock held. Compiling holds it alone, decoding never writes a compiled field, so decoders share it.
+wmem_allocator_t *schema_scope = NULL;
+wmem_list_t *protocol_sets = NULL; // every set, saved when a capture is closed
+GRWLock schema_lock;
+
+// Every decoding thread reuses its own recorder for all of its packets
+GPrivate thread_recorder = G_PRIVATE_INIT((GDestroyNotify) destroy_data_recorder);
+
+// "[i]" labels of array elements, shared by every array and grown when a longer one is decoded. Decoders read the
+// table without a lock, a grown one replaces it and the old one is kept.
+typedef struct {
+    guint count;
+    gchar **labels;
+} element_label_table;
+
+element_label_table *element_labels = NULL;
+GMutex element_label_mutex;
+
+wmem_allocator_t *get_schema_scope() {
+    return schema_scope;
+}
+
+void lock_schema() {
+    g_rw_lock_writer_lock(&schema_lock);
+}
+
+void unlock_schema() {
+    g_rw_lock_writer_unlock(&schema_lock);
+}
+
+void lock_schema_shared() {
+    g_rw_lock_reader_lock(&schema_lock);
+}
+
+void unlock_schema_shared() {
+    g_rw_lock_reader_unlock(&schema_lock);
+}
+
+gchar *get_element_label(guint index) {
+    element_label_table *table = g_atomic_pointer_get(&element_labels);
+    if (table != NULL && index < table->count)
+        return table->labels[index];
+    // Decoders only hold the schema lock shared, growing the table is the only write to the schema scope they make
+    g_mutex_lock(&element_label_mutex);
+    table = element_labels;
+    if (table == NULL || index >= table->count) {
+        guint old_count = table == NULL ? 0 : table->count;
+        element_label_table *grown = wmem_new(schema_scope, element_label_table);
+        grown->count = MAX(index + 1, old_count * 2);
+        grown->labels = wmem_alloc_array(schema_scope, gchar *, grown->count);
+        if (old_count > 0)
+            memcpy(grown->labels, table->labels, old_count * sizeof(gchar *));
+        for (guint i = old_count; i < grown->count; i++)
+            grown->labels[i] = wmem_strdup_printf(schema_scope, "[%u]", i);
+        COUNT_DECODE_ALLOCATION();
+        g_atomic_pointer_set(&element_labels, grown);
+        table = grown;
+    }
+    g_mutex_unlock(&element_label_mutex);
+    return table->labels[index];
+}
+
+data_recorder get_thread_recorder() {
+    data_recorder recorder = g_private_get(&thread_recorder);
+    if (recorder == NULL) {
+        recorder = create_data_recorder();
+        COUNT_DECODE_ALLOCATION();
+        g_private_set(&thread_recorder, recorder);
+    }
+    return recorder;
+}
+
+// ---------------------------------- Field Interning ----------------------------------
+// Compiled fields are shared between every place that would compile to the same thing, including other versions.
+// A compiled field depends on its schema node, the naming context, the named types it resolves and the settings it
+// reads, so the key holds the first two and each candidate remembers the rest, which must still match.
+
+typedef struct {
+    GPtrArray *resolved_types; // pairs of type name and resolved schema node, NULL name for a setting
+    protocol_field field;
+} interned_field;
+
+wmem_map_t *interned_field_map = NULL;
+#ifdef MC_DISSECTOR_AOT_DECODERS
+wmem_map_t *aot_decoder_map = NULL;
+#endif // MC_DISSECTOR_AOT_DECODERS
+GPtrArray *resolving_types = NULL;
+guint interned_field_count = 0;
+guint deduplicated_field_count = 0;
+
+guint get_interned_field_count() {
+    return interned_field_count;
+}
+
+guint get_deduplicated_field_count() {
+    return deduplicated_field_count;
+}
+
+schema_node resolve_type(schema_node types, const gchar *type) {
+    schema_node resolved = schema_get(types, type);
+    if (resolving_types != NULL) {
+        g_ptr_array_add(resolving_types, (gpointer) type);
+        g_ptr_array_add(resolving_types, (gpointer) resolved);
+    }
+    return resolved;
+}
+
+// Settings read while compiling are resolved with a NULL name and the setting shifted over its value
+#define SETTING_NBT_ANY_TYPE 0
+#define SETTING_CHUNK_SECTIONS 1
+#define SETTING_CHUNK_LONG_COUNTS 2
+
+bool get_setting(protocol_settings settings, guint setting) {
+    switch (setting) {
+        case SETTING_NBT_ANY_TYPE:
+            return settings.nbt_any_type;
+        case SETTING_CHUNK_SECTIONS:
+            return settings.chunk_sections;
+        default:
+            return settings.chunk_long_counts;
+    }
+}
+
+bool resolve_setting(protocol_settings settings, guint setting) {
+    bool value = get_setting(settings, setting);
+    if (resolving_types != NULL) {
+        g_ptr_array_add(resolving_types, NULL);
+        g_ptr_array_add(resolving_types, GUINT_TO_POINTER(setting << 1 | value));
+    }
+    return value;
+}
+
+gchar *make_intern_key(wmem_list_t *path_array, gchar *path_name, wmem_list_t *additional_flags,
+                       schema_node data, bool is_je, bool on_top) {
+    GString *key = g_string_new(NULL);
+    g_string_printf(key, "%u:%d:%d%d:%s", data->head, data->value, is_je, on_top, path_name);
+    for (wmem_list_frame_t *now = wmem_list_head(path_array); now != NULL; now = wmem_list_frame_next(now))
+        g_string_append_printf(key, "/%u", GPOINTER_TO_UINT(wmem_list_frame_data(now)));
+    for (wmem_list_frame_t *now = wmem_list_head(additional_flags); now != NULL; now = wmem_list_frame_next(now))
+        g_string_append_printf(key, "[%s]", (gchar *) wmem_list_frame_data(now));
+    return g_string_free(key, FALSE);
+}
+
+bool match_resolved_types(GPtrArray *resolved_types, schema_node types, protocol_settings settings) {
+    for (guint i = 0; i < resolved_types->len; i += 2) {
+        gchar *name = g_ptr_array_index(resolved_types, i);
+        gpointer resolved = g_ptr_array_index(resolved_types, i + 1);
+        guint setting = GPOINTER_TO_UINT(resolved);
+        if (name == NULL ? get_setting(settings, setting >> 1) != (setting & 1)
+                         : !schema_equals(schema_get(types, name), resolved))
+            return false;
+    }
+    return true;
+}
+
+// ---------------------------------- Case Tables ----------------------------------
+
+gint compare_protocol_case(gconstpointer a, gconstpointer b) {
+    return strcmp(((const protocol_case *) a)->key, ((const protocol_case *) b)->key);
+}
+
+void *find_protocol_case(protocol_case *cases, guint size, gchar *key) {
+    guint low = 0, high = size;
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        int compare = strcmp(cases[mid].key, key);
+        if (compare == 0)
+            return cases[mid].value;
+        if (compare < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return NULL;
+}
+
+bool parse_case_key(const gchar *key, gint64 *result) {
+    gchar *end;
+    gint64 value = g_ascii_strtoll(key, &end, 10);
+    if (end == key || *end != '\0')
+        return false;
+    // Only canonical keys, so comparing numbers gives the same answer as comparing text
+    gchar canonical[24]; // a sign and 19 digits at most
+    g_snprintf(canonical, sizeof(canonical), "%" G_GINT64_FORMAT, value);
+    bool same = strcmp(canonical, key) == 0;
+    *result = value;
+    return same;
+}
+
+typedef struct {
+    gint64 key;
+    void *value;
+} int_case;
+
+gint compare_int_case(gconstpointer a, gconstpointer b) {
+    gint64 key_a = ((const int_case *) a)->key, key_b = ((const int_case *) b)->key;
+    return key_a < key_b ? -1 : key_a > key_b;
+}
+
+void build_int_cases(protocol_int_cases *int_cases, protocol_case *cases, guint size) {
+    int_cases->available = false;
+    if (size == 0)
+        return;
+    int_case *sorted = g_new(int_case, size);
+    for (guint i = 0; i < size; i++) {
+        if (!parse_case_key(cases[i].key, &sorted[i].key)) {
+            g_free(sorted);
+            return;
+        }
+        sorted[i].value = cases[i].value;
+    }
+    qsort(sorted, size, sizeof(int_case), compare_int_case);
+
+    int_cases->size = size;
+    int_cases->keys = wmem_alloc_array(schema_scope, gint64, size);
+    int_cases->values = wmem_alloc_array(schema_scope, void *, size);
+    for (guint i = 0; i < size; i++) {
+        int_cases->keys[i] = sorted[i].key;
+        int_cases->values[i] = sorted[i].value;
+    }
+    g_free(sorted);
+
+    int_cases->min = int_cases->keys[0];
+    int_cases->range = 0;
+    int_cases->dense = NULL;
+    guint64 range = (guint64) (int_cases->keys[size - 1] - int_cases->min) + 1;
+    if (range <= DENSE_CASE_MAX_RANGE && range <= (guint64) size * 2) {
+        int_cases->range = (guint) range;
+        int_cases->dense = wmem_alloc0_array(schema_scope, void *, int_cases->range);
+        for (guint i = 0; i < size; i++)
+            int_cases->dense[int_cases->keys[i] - int_cases->min] = int_cases->values[i];
+    }
+    int_cases->available = true;
+}
+
+void *find_protocol_int_case(protocol_int_cases *int_cases, gint64 key) {
+    if (int_cases->dense != NULL) {
+        guint64 index = (guint64) (key - int_cases->min);
+        return key < int_cases->min || index >= int_cases->range ? NULL : int_cases->dense[index];
+    }
+    guint low = 0, high = int_cases->size;
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        if (int_cases->keys[mid] == key)
+            return int_cases->values[mid];
+        if (int_cases->keys[mid] < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return NULL;
+}
+
 // ---------------------------------- Native Fields ----------------------------------
 FIELD_MAKE_TREE(var_int) {
     guint result;
-    guint length = read_var_int(data + offset, remaining, &result);
+    gint length = read_var_int(data + offset, remaining, &result);
+    CHECK_READ(length)
     if (tree)
         proto_tree_add_uint(tree, field->hf_index, tvb, offset, length, record_uint(recorder, result));
     else
@@ -37,7 +320,8 @@ FIELD_MAKE_TREE(var_int) {
 
 FIELD_MAKE_TREE(var_long) {
     guint64 result;
-    guint length = read_var_long(data + offset, remaining, &result);
+    gint length = read_var_long(data + offset, remaining, &result);
+    CHECK_READ(length)
     if (tree)
         proto_tree_add_uint64(tree, field->hf_index, tvb, offset, length, record_uint64(recorder, result));
     else
@@ -47,7 +331,8 @@ FIELD_MAKE_TREE(var_long) {
 
 FIELD_MAKE_TREE(string) {
     guint8 *str;
-    guint length = read_buffer(data + offset, &str);
+    gint length = read_buffer(data + offset, remaining, &str);
+    CHECK_READ(length)
     if (tree)
         proto_tree_add_string(tree, field->hf_index, tvb, offset, length, record(recorder, str));
     else
@@ -57,7 +342,9 @@ FIELD_MAKE_TREE(string) {
 
 FIELD_MAKE_TREE(var_buffer) {
     guint length;
-    gint read = read_var_int(data + offset, 5, &length);
+    gint read = read_var_int(data + offset, remaining, &length);
+    CHECK_READ(read)
+    CHECK_LENGTH((guint64) read + length)
     if (tree) {
         if (length < BYTES_MAX_LENGTH)
             proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length + read,
@@ -69,27 +356,33 @@ FIELD_MAKE_TREE(var_buffer) {
     return read + length;
 }
 
-SINGLE_LENGTH_FIELD_MAKE(u8, 1, proto_tree_add_uint, tvb_get_guint8, record_uint)
+#define PEEK_U8(data) (*(data))
+#define PEEK_I8(data) ((gint8) *(data))
+#define PEEK_I16(data) ((gint16) peek_u16(data))
+#define PEEK_I32(data) ((gint32) peek_u32(data))
+#define PEEK_I64(data) ((gint64) peek_u64(data))
+
+SINGLE_LENGTH_FIELD_MAKE(u8, 1, proto_tree_add_uint, PEEK_U8, record_uint)
 
-SINGLE_LENGTH_FIELD_MAKE(u16, 2, proto_tree_add_uint, tvb_get_ntohs, record_uint)
+SINGLE_LENGTH_FIELD_MAKE(u16, 2, proto_tree_add_uint, peek_u16, record_uint)
 
-SINGLE_LENGTH_FIELD_MAKE(u32, 4, proto_tree_add_uint, tvb_get_ntohl, record_uint)
+SINGLE_LENGTH_FIELD_MAKE(u32, 4, proto_tree_add_uint, peek_u32, record_uint)
 
-SINGLE_LENGTH_FIELD_MAKE(u64, 8, proto_tree_add_uint64, tvb_get_ntoh64, record_uint64)
+SINGLE_LENGTH_FIELD_MAKE(u64, 8, proto_tree_add_uint64, peek_u64, record_uint64)
 
-SINGLE_LENGTH_FIELD_MAKE(i8, 1, proto_tree_add_int, tvb_get_gint8, record_int)
+SINGLE_LENGTH_FIELD_MAKE(i8, 1, proto_tree_add_int, PEEK_I8, record_int)
 
-SINGLE_LENGTH_FIELD_MAKE(i16, 2, proto_tree_add_int, tvb_get_ntohis, record_int)
+SINGLE_LENGTH_FIELD_MAKE(i16, 2, proto_tree_add_int, PEEK_I16, record_int)
 
-SINGLE_LENGTH_FIELD_MAKE(i32, 4, proto_tree_add_int, tvb_get_ntohil, record_int)
+SINGLE_LENGTH_FIELD_MAKE(i32, 4, proto_tree_add_int, PEEK_I32, record_int)
 
-SINGLE_LENGTH_FIELD_MAKE(i64, 8, proto_tree_add_int64, tvb_get_ntohi64, record_int64)
+SINGLE_LENGTH_FIELD_MAKE(i64, 8, proto_tree_add_int64, PEEK_I64, record_int64)
 
-SINGLE_LENGTH_FIELD_MAKE(f32, 4, proto_tree_add_float, tvb_get_ntohieee_float, record_float)
+SINGLE_LENGTH_FIELD_MAKE(f32, 4, proto_tree_add_float, peek_f32, record_float)
 
-SINGLE_LENGTH_FIELD_MAKE(f64, 8, proto_tree_add_double, tvb_get_ntohieee_double, record_double)
+SINGLE_LENGTH_FIELD_MAKE(f64, 8, proto_tree_add_double, peek_f64, record_double)
 
-SINGLE_LENGTH_FIELD_MAKE(boolean, 1, proto_tree_add_boolean, tvb_get_guint8, record_bool)
+SINGLE_LENGTH_FIELD_MAKE(boolean, 1, proto_tree_add_boolean, PEEK_U8, record_bool)
 
 FIELD_MAKE_TREE(rest_buffer) {
     if (tree) {
@@ -104,6 +397,7 @@ FIELD_MAKE_TREE(rest_buffer) {
 }
 
 FIELD_MAKE_TREE(uuid) {
+    CHECK_LENGTH(16)
     e_guid_t *uuid = wmem_new(wmem_packet_scope(), e_guid_t);
     tvb_get_guid(tvb, offset, uuid, 0);
     if (tree)
@@ -117,75 +411,68 @@ FIELD_MAKE_TREE(void) {
     return 0;
 }
 
+// Bytes of the NBT with its tags under them, value_offset is where the tag of the type starts
+void add_nbt_item(proto_tree *tree, tvbuff_t *tvb, const guint8 *data, protocol_field field, guint offset,
+                  guint length, guint value_offset, gint type) {
+    proto_item *item = proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length,
+                                            tvb_memdup(wmem_packet_scope(), tvb, offset,
+                                                       MIN(length, BYTES_MAX_LENGTH)));
+    add_nbt_tree(proto_item_add_subtree(item, ett_sub_je), tvb, data + value_offset, value_offset,
+                 length - (value_offset - offset), type);
+}
+
 FIELD_MAKE_TREE(nbt) {
-    guint length = count_nbt_length(data + offset);
-    if (tree) {
-        if (length < BYTES_MAX_LENGTH)
-            proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length,
-                                 tvb_memdup(wmem_packet_scope(), tvb, offset, length));
-        else
-            proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length,
-                                 tvb_memdup(wmem_packet_scope(), tvb, offset, BYTES_MAX_LENGTH));
-    }
+    gint length = count_nbt_length(data + offset, remaining);
+    CHECK_READ(length)
+    if (tree)
+        add_nbt_item(tree, tvb, data, field, offset, length, offset, NBT_NAMED_ROOT);
     return length;
 }
 
 FIELD_MAKE_TREE(optional_nbt) {
+    CHECK_LENGTH(1)
     guint8 present = data[offset];
     if (present != TAG_END) {
-        guint length = count_nbt_length(data + offset);
-        if (tree) {
-            if (length < BYTES_MAX_LENGTH)
-                proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length,
-                                     tvb_memdup(wmem_packet_scope(), tvb, offset, length));
-            else
-                proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length,
-                                     tvb_memdup(wmem_packet_scope(), tvb, offset, BYTES_MAX_LENGTH));
-        }
+        gint length = count_nbt_length(data + offset, remaining);
+        CHECK_READ(length)
+        if (tree)
+            add_nbt_item(tree, tvb, data, field, offset, length, offset, NBT_NAMED_ROOT);
         return length;
     } else
         return 1;
 }
 
 FIELD_MAKE_TREE(nbt_any_type) {
+    CHECK_LENGTH(1)
     guint8 present = data[offset];
     if (present != TAG_END) {
-        guint length = count_nbt_length_with_type(data + offset + 1, present);
-        if (tree) {
-            if (length < BYTES_MAX_LENGTH)
-                proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length + 1,
-                                     tvb_memdup(wmem_packet_scope(), tvb, offset, length + 1));
-            else
-                proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length + 1,
-                                     tvb_memdup(wmem_packet_scope(), tvb, offset, BYTES_MAX_LENGTH));
-        }
+        gint length = count_nbt_length_with_type(data + offset + 1, remaining - 1, present);
+        CHECK_READ(length)
+        if (tree)
+            add_nbt_item(tree, tvb, data, field, offset, length + 1, offset + 1, present);
         return length + 1;
     } else
         return 1;
 }
 
 DELEGATE_FIELD_MAKE_HEADER(container) {
-    bool not_top = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(-1)) == NULL;
-    gchar *now_record = record_get_recording(recorder);
-    if (not_top)
+    bool not_top = !field->container.on_top;
+    if (not_top) {
+        gchar *label = record_take_label(recorder, field->display_name);
         record_push(recorder);
-    if (tree && not_top)
-        tree = proto_tree_add_subtree(tree, tvb, offset, remaining,
-                                      is_je ? ett_sub_je : ett_sub_be, NULL, field->display_name);
-    guint length = GPOINTER_TO_UINT(wmem_map_lookup(field->additional_info, 0));
+        if (tree)
+            tree = proto_tree_add_subtree(tree, tvb, offset, remaining, is_je ? ett_sub_je : ett_sub_be, NULL, label);
+    }
+    protocol_field *children = field->container.children;
+    protocol_field *children_end = children + field->container.size;
     guint total_length = 0;
-    for (guint i = 1; i <= length; i++) {
-        protocol_field sub_field = wmem_map_lookup(field->additional_info, GUINT_TO_POINTER(i));
-        gchar *field_name = sub_field->name;
-        bool is_anon = field_name != NULL && strcmp(field_name, "[unnamed]") == 0;
-        if (is_anon && not_top) {
-            record_pop(recorder);
-            record_start(recorder, now_record);
+    for (; children < children_end; children++) {
+        protocol_field sub_field = *children;
+        if (sub_field->slot == RECORD_SLOT_UNNAMED && not_top) {
+            record_start(recorder, RECORD_SLOT_SAME);
             sub_field->make_tree(data, NULL, tvb, extra, sub_field, offset, remaining, recorder);
-            record_start(recorder, now_record);
-            record_push(recorder);
         }
-        record_start(recorder, sub_field->name);
+        record_start(recorder, sub_field->slot);
         guint sub_length = sub_field->make_tree(data, tree, tvb, extra, sub_field, offset, remaining, recorder);
         offset += sub_length;
         total_length += sub_length;
@@ -201,13 +488,10 @@ DELEGATE_FIELD_MAKE_HEADER(container) {
 DELEGATE_FIELD_MAKE(container)
 
 FIELD_MAKE_TREE(option) {
+    CHECK_LENGTH(1)
     bool is_present = tvb_get_guint8(tvb, offset) != 0;
-    protocol_field sub_field = wmem_map_lookup(field->additional_info, 0);
-    if (field->hf_resolved && field->hf_index != -1 && !sub_field->hf_resolved) {
-        sub_field->hf_index = field->hf_index;
-        sub_field->name = field->name;
-        sub_field->hf_resolved = true;
-    }
+    protocol_field sub_field = field->option.sub_field;
+    record_drop_label(recorder);
     if (is_present)
         return sub_field->make_tree(data, tree, tvb, extra, sub_field, offset + 1, remaining - 1, recorder) + 1;
     else
@@ -215,7 +499,8 @@ FIELD_MAKE_TREE(option) {
 }
 
 FIELD_MAKE_TREE(buffer) {
-    guint length = GPOINTER_TO_UINT(wmem_map_lookup(field->additional_info, 0));
+    guint length = field->buffer.length;
+    CHECK_LENGTH(length)
     if (tree) {
         if (length < BYTES_MAX_LENGTH)
             proto_tree_add_bytes(tree, field->hf_index, tvb, offset, length,
@@ -227,14 +512,22 @@ FIELD_MAKE_TREE(buffer) {
     return length;
 }
 
+// The value of the mapped type is recorded in its own slot and read back
+record_slot mapper_value_slots[] = {RECORD_SLOT_MAPPER_VALUE};
+record_path_t mapper_value_path = {NULL, 1, mapper_value_slots};
+
 FIELD_MAKE_TREE(mapper) {
-    protocol_field sub_field = wmem_map_lookup(field->additional_info, "__subfield");
-    gchar *recording = record_get_recording(recorder);
-    record_start(recorder, "__mapperValue");
+    protocol_field sub_field = field->mapper.sub_field;
+    record_slot recording = record_get_recording(recorder);
+    record_start(recorder, RECORD_SLOT_MAPPER_VALUE);
     guint length = sub_field->make_tree(data, NULL, tvb, extra, sub_field, offset, remaining, recorder);
-    char *path[] = {"__mapperValue", NULL};
-    gchar *map = record_query(recorder, path);
-    gchar *map_name = wmem_map_lookup(field->additional_info, map);
+    gint64 int_key;
+    gchar *map_name;
+    if (field->mapper.int_mappings.available && record_query_int(recorder, &mapper_value_path, &int_key))
+        map_name = find_protocol_int_case(&field->mapper.int_mappings, int_key);
+    else
+        map_name = find_protocol_case(field->mapper.mappings, field->mapper.size,
+                                      record_query(recorder, &mapper_value_path));
     record_start(recorder, recording);
     record(recorder, map_name);
     if (tree)
@@ -242,71 +535,169 @@ FIELD_MAKE_TREE(mapper) {
     return length;
 }
 
-DELEGATE_FIELD_MAKE_HEADER(array) {
-    protocol_field sub_field = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(1));
-    if (field->hf_resolved && field->hf_index != -1 && !sub_field->hf_resolved) {
-        sub_field->hf_index = field->hf_index;
-        sub_field->hf_resolved = true;
+guint array_element_limit = 0;
+
+#if defined(DEBUG) && defined(MC_DISSECTOR_CHECK_ALLOCATIONS)
+// Hashes of the packets decoded in this capture, with their entry and whether a tree was built. Trees made with other
+// preferences need other labels and NBT, so applying them starts a new generation.
+wmem_map_t *decoded_packets = NULL;
+guint decoded_generation = 0;
+
+bool check_decoded_before(protocol_entry entry, proto_tree *tree, const guint8 *data, guint length) {
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037) ^ GPOINTER_TO_SIZE(entry) ^ (tree != NULL) ^
+                   (guint64) decoded_generation << 32;
+    for (guint i = 0; i < length; i++)
+        hash = (hash ^ data[i]) * G_GUINT64_CONSTANT(1099511628211);
+    if (decoded_packets == NULL)
+        decoded_packets = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(), g_int64_hash, g_int64_equal);
+    if (wmem_map_contains(decoded_packets, &hash))
+        return true;
+    guint64 *key = wmem_new(wmem_file_scope(), guint64);
+    *key = hash;
+    wmem_map_insert(decoded_packets, key, key);
+    return false;
+}
+#endif // DEBUG && MC_DISSECTOR_CHECK_ALLOCATIONS
+
+void set_array_element_limit(guint limit) {
+    array_element_limit = limit;
+#if defined(DEBUG) && defined(MC_DISSECTOR_CHECK_ALLOCATIONS)
+    decoded_generation++;
+#endif // DEBUG && MC_DISSECTOR_CHECK_ALLOCATIONS
+}
+
+guint get_shown_element_count(guint count) {
+    return array_element_limit != 0 && count > array_element_limit ? array_element_limit : count;
+}
+
+void add_hidden_elements(proto_tree *tree, tvbuff_t *tvb, guint count, guint offset, guint length, bool is_je) {
+    proto_tree_add_bytes_format_value(tree, is_je ? hf_array_data_je : hf_array_data_be, tvb, offset, length, NULL,
+                                      "%u more elements (bytes %u..%u)", count, offset, offset + length);
+}
+
+guint get_fixed_width(protocol_field field) {
+    if (field->make_tree == make_tree_u8 || field->make_tree == make_tree_i8 || field->make_tree == make_tree_boolean)
+        return 1;
+    if (field->make_tree == make_tree_u16 || field->make_tree == make_tree_i16)
+        return 2;
+    if (field->make_tree == make_tree_u32 || field->make_tree == make_tree_i32 || field->make_tree == make_tree_f32)
+        return 4;
+    if (field->make_tree == make_tree_u64 || field->make_tree == make_tree_i64 || field->make_tree == make_tree_f64)
+        return 8;
+    if (field->make_tree == make_tree_uuid)
+        return 16;
+    return 0;
+}
+
+gint make_tree_fixed_width_elements(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                                    protocol_field field, guint offset, guint remaining, guint count,
+                                    data_recorder recorder, bool is_je) {
+    protocol_field sub_field = field->array.sub_field;
+    guint64 length = (guint64) count * field->array.element_width;
+    if (length > remaining)
+        return INVALID_DATA;
+    if (tree == NULL || count == 0)
+        return (gint) length;
+    proto_item *item = proto_tree_add_item(tree, is_je ? hf_array_data_je : hf_array_data_be, tvb,
+                                           offset, (gint) length, ENC_NA);
+    proto_tree *elements = proto_item_add_subtree(item, is_je ? ett_sub_je : ett_sub_be);
+    guint shown = get_shown_element_count(count);
+    for (guint i = 0; i < shown; i++) {
+        record_start_element(recorder, get_element_label(i));
+        offset += sub_field->make_tree(data, elements, tvb, extra, sub_field, offset, remaining, recorder);
     }
-    char **len_data = wmem_map_lookup(field->additional_info, 0);
+    if (shown < count)
+        add_hidden_elements(elements, tvb, count - shown, offset, (count - shown) * field->array.element_width, is_je);
+    return (gint) length;
+}
+
+DELEGATE_FIELD_MAKE_HEADER(array) {
+    protocol_field sub_field = field->array.sub_field;
+    gchar *label = record_take_label(recorder, field->display_name);
+    record_path count_path = field->array.count_path;
     guint len = 0;
     guint data_count = 0;
-    if (len_data == NULL)
-        len = read_var_int(data + offset, remaining, &data_count);
-    else {
-        char *end_ptr;
-        data_count = strtol(record_query(recorder, len_data), &end_ptr, 10);
+    gint64 count;
+    if (count_path == NULL) {
+        gint read = read_var_int(data + offset, remaining, &data_count);
+        CHECK_READ(read)
+        len = read;
+    } else if (record_query_int(recorder, count_path, &count)) {
+        CHECK_COUNT(count)
+        data_count = (guint) count;
     }
     proto_tree *sub_tree = NULL;
     if (tree) {
-        sub_tree = proto_tree_add_subtree(tree, tvb, offset, remaining,
-                                          is_je ? ett_sub_je : ett_sub_be, NULL, field->display_name);
+        sub_tree = proto_tree_add_subtree(tree, tvb, offset, remaining, is_je ? ett_sub_je : ett_sub_be, NULL, label);
         proto_tree_add_uint(sub_tree, is_je ? hf_array_length_je : hf_array_length_be, tvb,
                             offset, len, data_count);
     }
     offset += len;
     remaining -= len;
-    gchar *recording = record_get_recording(recorder);
-    char *name_raw = sub_field->name;
-    char *display_raw = sub_field->display_name;
-    for (int i = 0; i < data_count; i++) {
-        record_start(recorder, g_strconcat(recording, "[", g_strdup_printf("%d", i), "]", NULL));
-        if (field->name != NULL)
-            sub_field->name = g_strdup_printf("%s[%d]", field->name, i);
-        else
-            sub_field->name = g_strdup_printf("[%d]", i);
-        sub_field->display_name = g_strdup_printf("[%d]", i);
-        guint sub_length = sub_field->make_tree(data, sub_tree, tvb, extra, sub_field, offset, remaining, recorder);
+    if (tree == NULL && sub_field->make_tree == make_tree_var_int) {
+        // Elements are not recorded, without a tree there is nothing to do with their values
+        gint skipped = skip_var_ints(data + offset, remaining, data_count);
+        if (!is_invalid(skipped))
+            return len + skipped;
+    }
+    if (field->array.element_width != 0) {
+        gint elements_length = make_tree_fixed_width_elements(data, sub_tree, tvb, extra, field, offset, remaining,
+                                                               data_count, recorder, is_je);
+        if (!is_invalid(elements_length)) {
+            if (tree)
+                proto_item_set_len(sub_tree, len + elements_length);
+            return len + elements_length;
+        }
+    }
+    // Elements after the shown ones are decoded without a tree, so their offsets and queries stay right
+    guint shown = get_shown_element_count(data_count);
+    proto_tree *element_tree = sub_tree;
+    guint hidden_offset = offset;
+    for (guint i = 0; i < data_count; i++) {
+        if (i == shown) {
+            element_tree = NULL;
+            hidden_offset = offset;
+        }
+        record_start_element(recorder, element_tree ? get_element_label(i) : NULL);
+        guint sub_length = sub_field->make_tree(data, element_tree, tvb, extra, sub_field, offset, remaining,
+                                                recorder);
         offset += sub_length;
         len += sub_length;
         remaining -= sub_length;
     }
-    sub_field->name = name_raw;
-    sub_field->display_name = display_raw;
-    if (tree)
+    if (tree) {
+        if (shown < data_count)
+            add_hidden_elements(sub_tree, tvb, data_count - shown, hidden_offset, offset - hidden_offset, is_je);
         proto_item_set_len(sub_tree, len);
+    }
     return len;
 }
 
 DELEGATE_FIELD_MAKE(array)
 
 FIELD_MAKE_TREE(bitfield) {
-    int size = GPOINTER_TO_INT(wmem_map_lookup(field->additional_info, GINT_TO_POINTER(-1)));
-    int *const *bitfields = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(-2));
-    int total_bytes = GPOINTER_TO_INT(wmem_map_lookup(field->additional_info, GINT_TO_POINTER(-3)));
+    int size = (int) field->bitfield.size;
+    int *const *bitfields = field->bitfield.hf_indexes;
+    int total_bytes = (int) field->bitfield.total_bytes;
+    CHECK_LENGTH(field->bitfield.total_bytes)
     if (tree)
         for (int i = 0; i < size; i++) {
             int *hf_index = bitfields[i];
             if (hf_index != NULL)
                 proto_tree_add_item(tree, *hf_index, tvb, offset, total_bytes, ENC_NA);
         }
+    // No query reaches the bits of an unrecorded bitfield, and unrecorded bits are not read
+    bool recorded = record_get_recording(recorder) != RECORD_SLOT_NONE;
     record_push(recorder);
     int offset_bit = 0;
     for (int i = 0; i < size; i++) {
-        int len = GPOINTER_TO_INT(wmem_map_lookup(field->additional_info, GINT_TO_POINTER(i * 3)));
-        bool signed_ = GPOINTER_TO_INT(wmem_map_lookup(field->additional_info, GINT_TO_POINTER(i * 3 + 1)));
-        char *name = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(i * 3 + 2));
-        record_start(recorder, name);
+        int len = field->bitfield.bits[i];
+        bool signed_ = field->bitfield.signed_[i];
+        record_start(recorder, field->bitfield.slots[i]);
+        if (!recorded || record_get_recording(recorder) == RECORD_SLOT_NONE) {
+            offset_bit += len;
+            continue;
+        }
         if (len <= 32) {
             guint read = tvb_get_bits(tvb, offset * 8 + offset_bit, len, ENC_BIG_ENDIAN);
             if (signed_)
@@ -327,38 +718,24 @@ FIELD_MAKE_TREE(bitfield) {
 }
 
 DELEGATE_FIELD_MAKE_HEADER(top_bit_set_terminated_array) {
-    protocol_field sub_field = wmem_map_lookup(field->additional_info, 0);
-    if (field->hf_resolved && field->hf_index != -1 && !sub_field->hf_resolved) {
-        sub_field->hf_index = field->hf_index;
-        sub_field->name = field->name;
-        sub_field->hf_resolved = true;
-    }
+    protocol_field sub_field = field->top_bit_set_terminated_array.sub_field;
+    gchar *label = record_take_label(recorder, field->display_name);
     guint8 now;
     guint len = 0;
-    gchar *recording = record_get_recording(recorder);
-    char *name_raw = sub_field->name;
-    char *display_raw = sub_field->display_name;
     proto_tree *sub_tree = NULL;
     if (tree)
-        sub_tree = proto_tree_add_subtree(tree, tvb, offset, remaining,
-                                          is_je ? ett_sub_je : ett_sub_be, NULL, field->display_name);
+        sub_tree = proto_tree_add_subtree(tree, tvb, offset, remaining, is_je ? ett_sub_je : ett_sub_be, NULL, label);
     do {
+        CHECK_LENGTH(len + 1)
         now = data[offset++];
         len++;
         guint ord = now & 0x7F;
-        record_start(recorder, g_strconcat(recording, "[", g_strdup_printf("%d", ord), "]", NULL));
-        if (field->name != NULL)
-            sub_field->name = g_strdup_printf("%s[%d]", field->name, ord);
-        else
-            sub_field->name = g_strdup_printf("[%d]", ord);
-        sub_field->display_name = g_strdup_printf("[%d]", ord);
+        record_start_element(recorder, tree ? get_element_label(ord) : NULL);
         guint sub_length = sub_field->make_tree(data, sub_tree, tvb, extra, sub_field, offset, remaining - len,
                                                 recorder);
         offset += sub_length;
         len += sub_length;
     } while ((now & 0x80) != 0);
-    sub_field->name = name_raw;
-    sub_field->display_name = display_raw;
     if (tree)
         proto_item_set_len(sub_tree, len);
     return len;
@@ -366,59 +743,46 @@ DELEGATE_FIELD_MAKE_HEADER(top_bit_set_terminated_array) {
 
 DELEGATE_FIELD_MAKE(top_bit_set_terminated_array)
 
-FIELD_MAKE_TREE(switch) {
-    char **path = wmem_map_lookup(field->additional_info, "__path");
-    void *key = record_query(recorder, path);
-    protocol_field sub_field_choose = wmem_map_lookup(field->additional_info, key);
+protocol_field select_switch_case(protocol_field field, data_recorder recorder) {
+    record_path path = field->switch_.path;
+    gint64 int_key;
+    protocol_field sub_field_choose;
+    if (field->switch_.int_cases.available && record_query_int(recorder, path, &int_key))
+        sub_field_choose = find_protocol_int_case(&field->switch_.int_cases, int_key);
+    else
+        sub_field_choose = find_protocol_case(field->switch_.cases, field->switch_.size, record_query(recorder, path));
     if (sub_field_choose == NULL) // default
-        sub_field_choose = wmem_map_lookup(field->additional_info, "default");
+        sub_field_choose = field->switch_.default_field;
+    return sub_field_choose;
+}
+
+FIELD_MAKE_TREE(switch) {
+    protocol_field sub_field_choose = select_switch_case(field, recorder);
     if (sub_field_choose == NULL) // no case matched
         return 0;
-    if (field->hf_resolved && field->hf_index != -1 && !sub_field_choose->hf_resolved) {
-        sub_field_choose->hf_index = field->hf_index;
-        sub_field_choose->name = field->name;
-        sub_field_choose->hf_resolved = true;
-    }
-    char *display_name_raw = sub_field_choose->display_name;
-    sub_field_choose->display_name = field->display_name;
-    guint len = sub_field_choose->make_tree(data, tree, tvb, extra, sub_field_choose, offset, remaining, recorder);
-    sub_field_choose->display_name = display_name_raw;
-    return len;
+    record_pass_label(recorder, field->display_name);
+    return sub_field_choose->make_tree(data, tree, tvb, extra, sub_field_choose, offset, remaining, recorder);
 }
 
 DELEGATE_FIELD_MAKE_HEADER(entity_metadata_loop) {
-    protocol_field sub_field = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(0));
-    int end_val_1 = GPOINTER_TO_INT(wmem_map_lookup(field->additional_info, GINT_TO_POINTER(1)));
-    guint8 end_val = *(guint8 *) &end_val_1;
-    if (field->hf_resolved && field->hf_index != -1 && !sub_field->hf_resolved) {
-        sub_field->hf_index = field->hf_index;
-        sub_field->name = field->name;
-        sub_field->hf_resolved = true;
-    }
+    protocol_field sub_field = field->entity_metadata_loop.sub_field;
+    guint8 end_val = field->entity_metadata_loop.end_val;
+    gchar *label = record_take_label(recorder, field->display_name);
     int count = 0;
     guint len = 0;
-    gchar *recording = record_get_recording(recorder);
     proto_tree *sub_tree = NULL;
     if (tree)
-        sub_tree = proto_tree_add_subtree(tree, tvb, offset, remaining,
-                                          is_je ? ett_sub_je : ett_sub_be, NULL, field->display_name);
-    char *name_raw = sub_field->name;
-    char *display_name_raw = sub_field->display_name;
+        sub_tree = proto_tree_add_subtree(tree, tvb, offset, remaining, is_je ? ett_sub_je : ett_sub_be, NULL, label);
+    CHECK_LENGTH(1)
     while (data[offset] != end_val) {
-        record_start(recorder, g_strconcat(recording, "[", g_strdup_printf("%d", count), "]", NULL));
-        if (field->name != NULL)
-            sub_field->name = g_strdup_printf("%s[%d]", field->name, count);
-        else
-            sub_field->name = g_strdup_printf("[%d]", count);
-        sub_field->display_name = g_strdup_printf("[%d]", count);
+        record_start_element(recorder, tree ? get_element_label(count) : NULL);
         guint sub_length = sub_field->make_tree(data, sub_tree, tvb, extra, sub_field, offset, remaining - len,
                                                 recorder);
         offset += sub_length;
         len += sub_length;
         count++;
+        CHECK_LENGTH(len + 1)
     }
-    sub_field->name = name_raw;
-    sub_field->display_name = display_name_raw;
     if (tree)
         proto_item_set_len(sub_tree, len + 1);
     return len + 1;
@@ -427,22 +791,11 @@ DELEGATE_FIELD_MAKE_HEADER(entity_metadata_loop) {
 DELEGATE_FIELD_MAKE(entity_metadata_loop)
 
 FIELD_MAKE_TREE(basic_type) {
-    int len = GPOINTER_TO_INT(wmem_map_lookup(field->additional_info, GINT_TO_POINTER(-2)));
-    protocol_field sub_field = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(-1));
-    for (int i = 0; i < len; i++) {
-        gchar *name = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(i * 2));
-        gchar *value = wmem_map_lookup(field->additional_info, GINT_TO_POINTER(i * 2 + 1));
-        record_add_alias(recorder, name, value);
-    }
-    if (field->hf_resolved && field->hf_index != -1 && !sub_field->hf_resolved) {
-        sub_field->hf_index = field->hf_index;
-        sub_field->name = field->name;
-        sub_field->hf_resolved = true;
-    }
-    char *display_name_raw = sub_field->display_name;
-    sub_field->display_name = field->display_name;
+    protocol_field sub_field = field->basic_type.sub_field;
+    for (guint i = 0; i < field->basic_type.size; i++)
+        record_add_alias(recorder, field->basic_type.name_slots[i], field->basic_type.alias_slots[i]);
+    record_pass_label(recorder, field->display_name);
     guint sub_length = sub_field->make_tree(data, tree, tvb, extra, sub_field, offset, remaining, recorder);
-    sub_field->display_name = display_name_raw;
     record_clear_alias(recorder);
     return sub_length;
 }
@@ -464,10 +817,21 @@ wmem_map_t *function_make_tree = NULL;
     wmem_map_insert(function_make_tree, #json_name, make_tree_##func_name);
 
 void init_schema_data() {
-    native_make_tree_map = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
-    native_unknown_fallback_map = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
-    native_types = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
-    function_make_tree = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
+    schema_scope = wmem_allocator_new(WMEM_ALLOCATOR_BLOCK);
+    init_binary_schema(schema_scope);
+    protocol_sets = wmem_list_new(schema_scope);
+    interned_field_map = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    native_make_tree_map = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    native_unknown_fallback_map = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    native_types = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    function_make_tree = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    init_data_recorder(schema_scope);
+    init_protocol_vm();
+#ifdef MC_DISSECTOR_AOT_DECODERS
+    aot_decoder_map = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    for (const aot_decoder *decoder = AOT_DECODERS; decoder->name != NULL; decoder++)
+        wmem_map_insert(aot_decoder_map, (gpointer) decoder->name, (gpointer) decoder);
+#endif // MC_DISSECTOR_AOT_DECODERS
 
     ADD_NATIVE(varint, var_int, uint, u32)
     ADD_NATIVE(optvarint, var_int, uint, u32)
@@ -501,86 +865,91 @@ void init_schema_data() {
 #endif // MC_DISSECTOR_FUNCTION_FEATURE
 }
 
-int search_hf_index(bool is_je, wmem_list_t *path_array, gchar *name, wmem_list_t *additional_flags, gchar *type) {
-    wmem_map_t *search_hf_map = is_je ? name_hf_map_je : name_hf_map_be;
-    wmem_map_t *search_complex_name_map = is_je ? complex_name_map_je : complex_name_map_be;
-    wmem_map_t *search_complex_hf_map = is_je ? complex_hf_map_je : complex_hf_map_be;
-
-    if (path_array == NULL) {
-        int get_name = GPOINTER_TO_INT(wmem_map_lookup(search_hf_map, name));
-        if (get_name != 0)
-            return get_name;
-        gchar *mapped_name = wmem_map_lookup(search_complex_name_map, name);
-        if (mapped_name != NULL) {
-            get_name = GPOINTER_TO_INT(wmem_map_lookup(
-                    wmem_map_lookup(search_complex_hf_map, mapped_name), type));
-            if (get_name != 0)
-                return get_name;
-        }
-        return -1;
-    }
-
-    wmem_list_frame_t *now;
-    wmem_list_frame_t *now_flag = wmem_list_head(additional_flags);
-    while (now_flag != NULL) {
-        gchar *name_with_flag = g_strconcat(name, "[", wmem_list_frame_data(now_flag), "]", NULL);
-        now = wmem_list_head(path_array);
-        while (now != NULL) {
-            int get_name = GPOINTER_TO_INT(wmem_map_lookup(search_hf_map,
-                                                           name_with_flag +
-                                                           GPOINTER_TO_UINT(wmem_list_frame_data(now))));
-            if (get_name != 0)
-                return get_name;
-            gchar *mapped_name = wmem_map_lookup(search_complex_name_map, name_with_flag +
-                                                                          GPOINTER_TO_UINT(wmem_list_frame_data(now)));
-            if (mapped_name != NULL) {
-                get_name = GPOINTER_TO_INT(wmem_map_lookup(
-                        wmem_map_lookup(search_complex_hf_map, mapped_name), type));
-                if (get_name != 0)
-                    return get_name;
-            }
-            now = wmem_list_frame_next(now);
-        }
-        now_flag = wmem_list_frame_next(now_flag);
-    }
-
-    now = wmem_list_head(path_array);
-    while (now != NULL) {
-        int get_name = GPOINTER_TO_INT(wmem_map_lookup(search_hf_map,
-                                                       name + GPOINTER_TO_UINT(wmem_list_frame_data(now))));
-        if (get_name != 0)
-            return get_name;
-        gchar *mapped_name = wmem_map_lookup(search_complex_name_map, name +
-                                                                      GPOINTER_TO_UINT(wmem_list_frame_data(now)));
-        if (mapped_name != NULL) {
-            get_name = GPOINTER_TO_INT(wmem_map_lookup(
-                    wmem_map_lookup(search_complex_hf_map, mapped_name), type));
-            if (get_name != 0)
-                return get_name;
-        }
-        now = wmem_list_frame_next(now);
+const name_trie_node *name_trie_step(const name_trie_node *trie, const name_trie_node *node, gchar c) {
+    guint low = node->first_child, high = node->first_child + node->child_count;
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        if (trie[mid].c == c)
+            return trie + mid;
+        if (trie[mid].c < c)
+            low = mid + 1;
+        else
+            high = mid;
     }
-    return -1;
+    return NULL;
 }
 
-gchar *search_name(bool is_je, wmem_list_t *path_array, gchar *name) {
-    wmem_map_t *search_map = is_je ? component_map_je : component_map_be;
-    if (path_array == NULL) {
-        gchar *get_name = wmem_map_lookup(search_map, name);
-        if (get_name != NULL)
-            return get_name;
-        return "unnamed";
+bool is_path_start(wmem_list_t *path_array, guint offset) {
+    if (path_array == NULL)
+        return offset == 0;
+    for (wmem_list_frame_t *now = wmem_list_head(path_array); now != NULL; now = wmem_list_frame_next(now))
+        if (GPOINTER_TO_UINT(wmem_list_frame_data(now)) == offset)
+            return true;
+    return false;
+}
+
+typedef bool (*name_trie_accept)(const name_trie_node *node, gpointer user_data);
+
+// Walks "name[flag]" backwards, the last accepted node is the longest path suffix that matches
+const name_trie_node *search_name_trie(const name_trie_node *trie, wmem_list_t *path_array, gchar *name,
+                                       const gchar *flag, name_trie_accept accept, gpointer user_data) {
+    const name_trie_node *node = trie;
+    if (flag != NULL) {
+        node = name_trie_step(trie, node, ']');
+        for (gint i = (gint) strlen(flag) - 1; i >= 0 && node != NULL; i--)
+            node = name_trie_step(trie, node, flag[i]);
+        if (node != NULL)
+            node = name_trie_step(trie, node, '[');
+    }
+    const name_trie_node *found = NULL;
+    for (gint i = (gint) strlen(name) - 1; i >= 0 && node != NULL; i--) {
+        node = name_trie_step(trie, node, name[i]);
+        if (node != NULL && accept(node, user_data) && is_path_start(path_array, i))
+            found = node;
     }
+    return found;
+}
+
+typedef struct {
+    wmem_map_t *complex_hf_map;
+    gchar *type;
+} hf_search;
+
+int get_node_hf_index(const name_trie_node *node, hf_search *search) {
+    if (node->hf_index != NULL && *node->hf_index != 0)
+        return *node->hf_index;
+    if (node->complex_name != NULL)
+        return GPOINTER_TO_INT(wmem_map_lookup(wmem_map_lookup(search->complex_hf_map, node->complex_name),
+                                               search->type));
+    return 0;
+}
+
+bool accept_hf_node(const name_trie_node *node, gpointer user_data) {
+    return get_node_hf_index(node, user_data) != 0;
+}
 
-    wmem_list_frame_t *now = wmem_list_head(path_array);
-    while (now != NULL) {
-        gchar *get_name = wmem_map_lookup(search_map, name + GPOINTER_TO_UINT(wmem_list_frame_data(now)));
-        if (get_name != NULL)
-            return get_name;
-        now = wmem_list_frame_next(now);
+bool accept_component_node(const name_trie_node *node, gpointer user_data _U_) {
+    return node->component_name != NULL;
+}
+
+int search_hf_index(bool is_je, wmem_list_t *path_array, gchar *name, wmem_list_t *additional_flags, gchar *type) {
+    const name_trie_node *trie = is_je ? name_trie_je : name_trie_be;
+    hf_search search = {is_je ? complex_hf_map_je : complex_hf_map_be, type};
+    const name_trie_node *found;
+    for (wmem_list_frame_t *now_flag = wmem_list_head(additional_flags);
+         now_flag != NULL && path_array != NULL; now_flag = wmem_list_frame_next(now_flag)) {
+        found = search_name_trie(trie, path_array, name, wmem_list_frame_data(now_flag), accept_hf_node, &search);
+        if (found != NULL)
+            return get_node_hf_index(found, &search);
     }
+    found = search_name_trie(trie, path_array, name, NULL, accept_hf_node, &search);
+    return found != NULL ? get_node_hf_index(found, &search) : -1;
+}
 
-    return "unnamed";
+gchar *search_name(bool is_je, wmem_list_t *path_array, gchar *name) {
+    const name_trie_node *found = search_name_trie(is_je ? name_trie_je : name_trie_be, path_array, name, NULL,
+                                                   accept_component_node, NULL);
+    return found != NULL ? (gchar *) found->component_name : "unnamed";
 }
 
 #define NAME_PUSH(x) \
@@ -590,17 +959,63 @@ gchar *search_name(bool is_je, wmem_list_t *path_array, gchar *name) {
     wmem_list_remove_frame(path_array, wmem_list_tail(path_array)); \
     path_name[path_length] = '\0';
 
+protocol_field compile_protocol_field(wmem_list_t *path_array, gchar *path_name, wmem_list_t *additional_flags,
+                                      wmem_map_t *basic_types, schema_node data, schema_node types,
+                                      bool is_je, bool on_top, protocol_settings settings);
+
 protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_list_t *additional_flags,
-                              wmem_map_t *basic_types, cJSON *data, cJSON *types,
+                              wmem_map_t *basic_types, schema_node data, schema_node types,
                               bool is_je, bool on_top, protocol_settings settings) {
     if (data == NULL)
         return NULL;
+    gchar *key = make_intern_key(path_array, path_name, additional_flags, data, is_je, on_top);
+    wmem_list_t *candidates = wmem_map_lookup(interned_field_map, key);
+    if (candidates == NULL) {
+        candidates = wmem_list_new(schema_scope);
+        wmem_map_insert(interned_field_map, key, candidates);
+    } else
+        g_free(key);
+
+    interned_field *found = NULL;
+    for (wmem_list_frame_t *now = wmem_list_head(candidates); now != NULL; now = wmem_list_frame_next(now)) {
+        interned_field *candidate = wmem_list_frame_data(now);
+        if (match_resolved_types(candidate->resolved_types, types, settings)) {
+            found = candidate;
+            break;
+        }
+    }
+
+    if (found != NULL) {
+        deduplicated_field_count++;
+    } else {
+        GPtrArray *outer_types = resolving_types;
+        resolving_types = g_ptr_array_new();
+        protocol_field field = compile_protocol_field(path_array, path_name, additional_flags, basic_types,
+                                                      data, types, is_je, on_top, settings);
+        found = wmem_new(schema_scope, interned_field);
+        found->resolved_types = resolving_types;
+        found->field = field;
+        wmem_list_append(candidates, found);
+        resolving_types = outer_types;
+        interned_field_count++;
+    }
+
+    // The enclosing field depends on everything this one resolved
+    if (resolving_types != NULL)
+        for (guint i = 0; i < found->resolved_types->len; i++)
+            g_ptr_array_add(resolving_types, g_ptr_array_index(found->resolved_types, i));
+    return found->field;
+}
+
+protocol_field compile_protocol_field(wmem_list_t *path_array, gchar *path_name, wmem_list_t *additional_flags,
+                                      wmem_map_t *basic_types, schema_node data, schema_node types,
+                                      bool is_je, bool on_top, protocol_settings settings) {
     guint path_length = strlen(path_name);
-    if (cJSON_IsString(data)) {
-        char *type = data->valuestring;
+    if (schema_is_string(data)) {
+        char *type = (char *) schema_string(data);
         void *make_tree_func = wmem_map_lookup(native_make_tree_map, type);
         if (make_tree_func != NULL) {
-            protocol_field field = wmem_new(wmem_epan_scope(), protocol_field_t);
+            protocol_field field = wmem_new0(schema_scope, protocol_field_t);
             field->hf_index = search_hf_index(is_je, path_array, path_name, additional_flags,
                                               wmem_map_lookup(native_types, type));
             if (field->hf_index != -1)
@@ -612,10 +1027,9 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
                 field->hf_resolved = false;
             }
             field->name = NULL;
-            field->additional_info = NULL;
             field->make_tree = make_tree_func;
 
-            if (settings.nbt_any_type && strcmp(type, "nbt") == 0)
+            if (strcmp(type, "nbt") == 0 && resolve_setting(settings, SETTING_NBT_ANY_TYPE))
                 field->make_tree = make_tree_nbt_any_type;
 
             return field;
@@ -625,18 +1039,18 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
             return field;
         NAME_PUSH(type)
         field = parse_protocol(path_array, path_name, additional_flags, basic_types,
-                               cJSON_GetObjectItem(types, data->valuestring),
+                               resolve_type(types, type),
                                types, is_je, false, settings);
         NAME_POP
         return field;
     }
-    if (cJSON_GetArraySize(data) != 2)
+    if (schema_size(data) != 2)
         return NULL;
-    char *type = cJSON_GetArrayItem(data, 0)->valuestring;
-    cJSON *fields = cJSON_GetArrayItem(data, 1);
+    char *type = (char *) schema_string(schema_at(data, 0));
+    schema_node fields = schema_at(data, 1);
+    schema_node type_definition;
 
-    protocol_field field = wmem_new(wmem_epan_scope(), protocol_field_t);
-    field->additional_info = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
+    protocol_field field = wmem_new0(schema_scope, protocol_field_t);
     field->make_tree = NULL;
     field->name = NULL;
     field->hf_index = -1;
@@ -645,21 +1059,23 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
 
     if (strcmp(type, "function") == 0) {
 #ifdef MC_DISSECTOR_FUNCTION_FEATURE
-        field->make_tree = wmem_map_lookup(function_make_tree, fields->valuestring);
+        field->make_tree = wmem_map_lookup(function_make_tree, schema_string(fields));
 #else
         field->make_tree = make_tree_void;
 #endif // MC_DISSECTOR_FUNCTION_FEATURE
         return field;
     } else if (strcmp(type, "container") == 0) { // container
         field->make_tree = is_je ? make_tree_je_container : make_tree_be_container;
-        int size = cJSON_GetArraySize(fields);
-        wmem_map_insert(field->additional_info, 0, GINT_TO_POINTER(size));
+        int size = (int) schema_size(fields);
+        field->container.size = size;
+        field->container.on_top = on_top;
+        field->container.children = wmem_alloc_array(schema_scope, protocol_field, size);
         for (int i = 0; i < size; i++) {
-            cJSON *field_data = cJSON_GetArrayItem(fields, i);
-            cJSON *type_data = cJSON_GetObjectItem(field_data, "type");
+            schema_node field_data = schema_at(fields, i);
+            schema_node type_data = schema_get(field_data, "type");
             gchar *sub_field_name;
-            if (cJSON_HasObjectItem(field_data, "name"))
-                sub_field_name = strdup(cJSON_GetObjectItem(field_data, "name")->valuestring);
+            if (schema_has(field_data, "name"))
+                sub_field_name = (gchar *) schema_string(schema_get(field_data, "name"));
             else
                 sub_field_name = "[unnamed]";
             NAME_PUSH(sub_field_name)
@@ -668,11 +1084,16 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
             NAME_POP
             if (sub_field == NULL)
                 return NULL;
+            if (sub_field->name != NULL && strcmp(sub_field->name, sub_field_name) != 0) {
+                // Shared with a container that names it differently
+                protocol_field named_field = wmem_new(schema_scope, protocol_field_t);
+                *named_field = *sub_field;
+                sub_field = named_field;
+            }
             sub_field->name = sub_field_name;
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(i + 1), sub_field);
+            sub_field->slot = record_intern(sub_field_name);
+            field->container.children[i] = sub_field;
         }
-        if (on_top)
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(-1), GINT_TO_POINTER(1));
         return field;
     } else if (strcmp(type, "option") == 0) { // option
         field->make_tree = make_tree_option;
@@ -680,7 +1101,7 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
                                                   fields, types, is_je, false, settings);
         if (sub_field == NULL)
             return NULL;
-        wmem_map_insert(field->additional_info, 0, sub_field);
+        field->option.sub_field = sub_field;
         return field;
     } else if (strcmp(type, "buffer") == 0) { // buffer
         field->hf_index = search_hf_index(is_je, path_array, path_name, additional_flags, "bytes");
@@ -689,16 +1110,19 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
         else
             field->hf_index = GPOINTER_TO_INT(wmem_map_lookup(
                     is_je ? unknown_hf_map_je : unknown_hf_map_be, "bytes"));
-        if (cJSON_HasObjectItem(fields, "count")) {
+        if (schema_has(fields, "count")) {
             field->make_tree = make_tree_buffer;
-            cJSON *count = cJSON_GetObjectItem(fields, "count");
-            wmem_map_insert(field->additional_info, 0, GINT_TO_POINTER(count->valueint));
-        } else
+            schema_node count = schema_get(fields, "count");
+            field->buffer.length = schema_int(count);
+        } else if (is_je && strcmp(path_name, "map_chunk/chunkData") == 0 &&
+                   resolve_setting(settings, SETTING_CHUNK_SECTIONS))
+            field->make_tree = resolve_setting(settings, SETTING_CHUNK_LONG_COUNTS) ? make_tree_chunk_data
+                                                                                    : make_tree_unprefixed_chunk_data;
+        else
             field->make_tree = make_tree_var_buffer;
         return field;
     } else if (strcmp(type, "mapper") == 0) { // mapper
-        field->additional_info = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
-        cJSON *type_data = cJSON_GetObjectItem(fields, "type");
+        schema_node type_data = schema_get(fields, "type");
         protocol_field sub_field = parse_protocol(path_array, path_name, additional_flags, basic_types,
                                                   type_data, types, is_je, false, settings);
         if (sub_field == NULL)
@@ -710,132 +1134,147 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
         else
             field->hf_index = GPOINTER_TO_INT(wmem_map_lookup(
                     is_je ? unknown_hf_map_je : unknown_hf_map_be, "string"));
-        wmem_map_insert(field->additional_info, "__subfield", sub_field);
-        cJSON *mappings = cJSON_GetObjectItem(fields, "mappings");
-        cJSON *now = mappings->child;
-        while (now != NULL) {
-            char *key = now->string;
-            char *value = now->valuestring;
-            wmem_map_insert(field->additional_info, strdup(key), strdup(value));
-            now = now->next;
+        field->mapper.sub_field = sub_field;
+        schema_node mappings = schema_get(fields, "mappings");
+        guint mapping_count = schema_size(mappings);
+        field->mapper.size = mapping_count;
+        field->mapper.mappings = wmem_alloc_array(schema_scope, protocol_case, mapping_count);
+        for (guint i = 0; i < mapping_count; i++) {
+            schema_node now = schema_at(mappings, i);
+            field->mapper.mappings[i].key = (gchar *) schema_key(now);
+            field->mapper.mappings[i].value = (gpointer) schema_string(now);
         }
+        qsort(field->mapper.mappings, mapping_count, sizeof(protocol_case), compare_protocol_case);
+        build_int_cases(&field->mapper.int_mappings, field->mapper.mappings, mapping_count);
         return field;
     } else if (strcmp(type, "array") == 0) { // array
-        cJSON *count = cJSON_GetObjectItem(fields, "count");
+        schema_node count = schema_get(fields, "count");
         if (count != NULL)
-            wmem_map_insert(field->additional_info, 0,
-                            g_strsplit(count->valuestring, "/", 10));
+            field->array.count_path = record_compile_path(schema_scope, g_strsplit(schema_string(count), "/", 10));
         else {
-            cJSON *count_type = cJSON_GetObjectItem(fields, "countType");
-            if (count_type == NULL || strcmp(count_type->valuestring, "varint") != 0)
+            schema_node count_type = schema_get(fields, "countType");
+            if (!schema_is_string(count_type) || strcmp(schema_string(count_type), "varint") != 0)
                 return NULL;
         }
 
-        cJSON *type_data = cJSON_GetObjectItem(fields, "type");
+        schema_node type_data = schema_get(fields, "type");
         protocol_field sub_field = parse_protocol(path_array, path_name, additional_flags, basic_types,
                                                   type_data, types, is_je, false, settings);
         if (sub_field == NULL)
             return NULL;
         field->make_tree = is_je ? make_tree_je_array : make_tree_be_array;
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(1), sub_field);
+        field->array.sub_field = sub_field;
+        field->array.element_width = get_fixed_width(sub_field);
         return field;
     } else if (strcmp(type, "bitfield") == 0) {
-        int size = cJSON_GetArraySize(fields);
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(-1), GINT_TO_POINTER(size));
+        int size = (int) schema_size(fields);
+        field->bitfield.size = size;
+        field->bitfield.bits = wmem_alloc_array(schema_scope, guint8, size);
+        field->bitfield.signed_ = wmem_alloc_array(schema_scope, bool, size);
+        field->bitfield.names = wmem_alloc_array(schema_scope, gchar *, size);
+        field->bitfield.slots = wmem_alloc_array(schema_scope, record_slot, size);
         char *bitmask_name = "";
         int total_bits = 0;
         for (int i = 0; i < size; i++) {
-            cJSON *field_data = cJSON_GetArrayItem(fields, i);
-            bool signed_ = cJSON_GetObjectItem(field_data, "signed")->valueint;
-            int bits = cJSON_GetObjectItem(field_data, "size")->valueint;
-            char *name = cJSON_GetObjectItem(field_data, "name")->valuestring;
+            schema_node field_data = schema_at(fields, i);
+            bool signed_ = schema_int(schema_get(field_data, "signed"));
+            int bits = schema_int(schema_get(field_data, "size"));
+            char *name = (char *) schema_string(schema_get(field_data, "name"));
             bitmask_name = g_strdup_printf("%s[%d]%s", bitmask_name, bits, name);
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(i * 3), GINT_TO_POINTER(bits));
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(i * 3 + 1), GINT_TO_POINTER(signed_));
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(i * 3 + 2), strdup(name));
+            field->bitfield.bits[i] = bits;
+            field->bitfield.signed_[i] = signed_;
+            field->bitfield.names[i] = name;
+            field->bitfield.slots[i] = record_intern(name);
             total_bits += bits;
         }
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(-3), GINT_TO_POINTER(total_bits / 8));
+        field->bitfield.total_bytes = total_bits / 8;
         int **hf_data = wmem_map_lookup(is_je ? bitmask_hf_map_je : bitmask_hf_map_be, bitmask_name);
         if (hf_data == NULL)
             return NULL;
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(-2), hf_data);
+        field->bitfield.hf_indexes = hf_data;
         field->make_tree = make_tree_bitfield;
         field->hf_resolved = true;
         return field;
     } else if (strcmp(type, "topBitSetTerminatedArray") == 0) {
         protocol_field sub_field = parse_protocol(path_array, path_name, additional_flags, basic_types,
-                                                  cJSON_GetObjectItem(fields, "type"),
+                                                  schema_get(fields, "type"),
                                                   types, is_je, false, settings);
         if (sub_field == NULL)
             return NULL;
-        wmem_map_insert(field->additional_info, 0, sub_field);
+        field->top_bit_set_terminated_array.sub_field = sub_field;
         field->make_tree = is_je ? make_tree_je_top_bit_set_terminated_array
                                  : make_tree_be_top_bit_set_terminated_array;
         return field;
     } else if (strcmp(type, "switch") == 0) {
-        char *compare_data = cJSON_GetObjectItem(fields, "compareTo")->valuestring;
-        char **compare_data_split = g_strsplit(strdup(compare_data), "/", 10);
-        field->additional_info = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
-        wmem_map_insert(field->additional_info, strdup("__path"), compare_data_split);
-        if (cJSON_HasObjectItem(fields, "default")) {
-            cJSON *default_data = cJSON_GetObjectItem(fields, "default");
+        const char *compare_data = schema_string(schema_get(fields, "compareTo"));
+        field->switch_.path = record_compile_path(schema_scope, g_strsplit(compare_data, "/", 10));
+        if (schema_has(fields, "default")) {
+            schema_node default_data = schema_get(fields, "default");
             wmem_list_prepend(additional_flags, "default");
             protocol_field default_field = parse_protocol(path_array, path_name, additional_flags, basic_types,
                                                           default_data, types, is_je, false, settings);
             wmem_list_remove_frame(additional_flags, wmem_list_head(additional_flags));
             if (default_field == NULL)
                 return NULL;
-            wmem_map_insert(field->additional_info, strdup("default"), default_field);
+            field->switch_.default_field = default_field;
         }
-        cJSON *cases = cJSON_GetObjectItem(fields, "fields");
+        schema_node cases = schema_get(fields, "fields");
         if (cases == NULL)
             return NULL;
-        cJSON *now = cases->child;
-        while (now != NULL) {
-            char *key = now->string;
+        guint case_count = schema_size(cases);
+        field->switch_.size = case_count;
+        field->switch_.cases = wmem_alloc_array(schema_scope, protocol_case, case_count);
+        for (guint i = 0; i < case_count; i++) {
+            schema_node now = schema_at(cases, i);
+            char *key = (char *) schema_key(now);
             wmem_list_prepend(additional_flags, key);
             protocol_field value = parse_protocol(path_array, path_name, additional_flags, basic_types,
                                                   now, types, is_je, false, settings);
             wmem_list_remove_frame(additional_flags, wmem_list_head(additional_flags));
             if (value == NULL)
                 return NULL;
-            wmem_map_insert(field->additional_info, strdup(key), value);
-            now = now->next;
+            field->switch_.cases[i].key = key;
+            field->switch_.cases[i].value = value;
         }
+        qsort(field->switch_.cases, case_count, sizeof(protocol_case), compare_protocol_case);
+        build_int_cases(&field->switch_.int_cases, field->switch_.cases, case_count);
         field->make_tree = make_tree_switch;
         return field;
     } else if (strcmp(type, "entityMetadataLoop") == 0) {
         protocol_field sub_field = parse_protocol(path_array, path_name, additional_flags, basic_types,
-                                                  cJSON_GetObjectItem(fields, "type"),
+                                                  schema_get(fields, "type"),
                                                   types, is_je, false, settings);
         if (sub_field == NULL)
             return NULL;
-        int end_val = cJSON_GetObjectItem(fields, "endVal")->valueint;
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(0), sub_field);
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(1), GINT_TO_POINTER(end_val));
+        field->entity_metadata_loop.sub_field = sub_field;
+        field->entity_metadata_loop.end_val = (guint8) schema_int(schema_get(fields, "endVal"));
         field->make_tree = is_je ? make_tree_je_entity_metadata_loop : make_tree_be_entity_metadata_loop;
         return field;
-    } else if (cJSON_HasObjectItem(types, type)) {
+    } else if ((type_definition = resolve_type(types, type)) != NULL) {
         protocol_field_t *type_data = wmem_map_lookup(basic_types, type);
         if (type_data == NULL) {
             NAME_PUSH(type)
             type_data = parse_protocol(path_array, path_name, additional_flags, basic_types,
-                                       cJSON_GetObjectItem(types, type), types, is_je, false, settings);
+                                       type_definition, types, is_je, false, settings);
             NAME_POP
         }
         if (type_data == NULL)
             return NULL;
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(-1), type_data);
-        cJSON *now = fields->child;
-        int i = 0;
-        while (now != NULL) {
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(i * 2), g_strconcat("$", now->string, NULL));
-            wmem_map_insert(field->additional_info, GINT_TO_POINTER(i * 2 + 1), strdup(now->valuestring));
-            now = now->next;
-            i++;
+        guint size = schema_size(fields);
+        field->basic_type.sub_field = type_data;
+        field->basic_type.size = size;
+        field->basic_type.names = wmem_alloc_array(schema_scope, gchar *, size);
+        field->basic_type.aliases = wmem_alloc_array(schema_scope, gchar *, size);
+        field->basic_type.name_slots = wmem_alloc_array(schema_scope, record_slot, size);
+        field->basic_type.alias_slots = wmem_alloc_array(schema_scope, record_slot, size);
+        for (guint i = 0; i < size; i++) {
+            schema_node now = schema_at(fields, i);
+            field->basic_type.names[i] = g_strconcat("$", schema_key(now), NULL);
+            field->basic_type.aliases[i] = (gchar *) schema_string(now);
+            field->basic_type.name_slots[i] = record_intern(field->basic_type.names[i]);
+            field->basic_type.alias_slots[i] = record_intern(field->basic_type.aliases[i]);
+            record_use(field->basic_type.alias_slots[i]);
         }
-        wmem_map_insert(field->additional_info, GINT_TO_POINTER(-2), GINT_TO_POINTER(i));
         field->make_tree = make_tree_basic_type;
         return field;
     }
@@ -843,60 +1282,111 @@ protocol_field parse_protocol(wmem_list_t *path_array, gchar *path_name, wmem_li
     return NULL;
 }
 
-void make_simple_protocol(cJSON *data, cJSON *types, wmem_map_t *packet_map, wmem_map_t *name_map, bool is_je,
-                          protocol_settings settings) {
-    cJSON *packets = cJSON_GetObjectItem(data, "packet");
+void make_simple_protocol(schema_node data, schema_node types, protocol_packets *packet_table, bool is_je,
+                          protocol_settings settings, gchar *set_name, gchar *side) {
+    schema_node packets = schema_get(data, "packet");
     // Path: [1].[0].type.[1].mappings
-    cJSON *c1 = cJSON_GetArrayItem(packets, 1);
-    cJSON *c2 = cJSON_GetArrayItem(c1, 0);
-    cJSON *c3 = cJSON_GetObjectItem(c2, "type");
-    cJSON *c4 = cJSON_GetArrayItem(c3, 1);
-    cJSON *mappings = cJSON_GetObjectItem(c4, "mappings");
-    cJSON *now = mappings->child;
-    while (now != NULL) {
-        char *packet_id_str = now->string;
-        gchar *packet_name = strdup(now->valuestring);
-        char *ptr;
-        guint packet_id = (guint) strtol(packet_id_str + 2, &ptr, 16);
-        wmem_map_insert(name_map, packet_name, GUINT_TO_POINTER(packet_id + 1));
-
-        protocol_entry entry = wmem_new(wmem_epan_scope(), protocol_entry_t);
+    schema_node c1 = schema_at(packets, 1);
+    schema_node c2 = schema_at(c1, 0);
+    schema_node c3 = schema_get(c2, "type");
+    schema_node c4 = schema_at(c3, 1);
+    schema_node mappings = schema_get(c4, "mappings");
+    guint mapping_count = schema_size(mappings);
+    guint *packet_ids = g_new(guint, mapping_count);
+    packet_table->size = 0;
+    for (guint i = 0; i < mapping_count; i++) {
+        packet_ids[i] = (guint) strtol(schema_key(schema_at(mappings, i)) + 2, NULL, 16);
+        packet_table->size = MAX(packet_table->size, packet_ids[i] + 1);
+    }
+    packet_table->entries = wmem_alloc0_array(schema_scope, protocol_entry, packet_table->size);
+    packet_table->name_map = wmem_map_new(schema_scope, g_str_hash, g_str_equal);
+    for (guint i = 0; i < mapping_count; i++) {
+        schema_node now = schema_at(mappings, i);
+        gchar *packet_name = (gchar *) schema_string(now);
+        guint packet_id = packet_ids[i];
+        wmem_map_insert(packet_table->name_map, packet_name, GUINT_TO_POINTER(packet_id + 1));
+
+        protocol_entry entry = wmem_new(schema_scope, protocol_entry_t);
         entry->id = packet_id;
         entry->name = packet_name;
-        wmem_map_insert(packet_map, GUINT_TO_POINTER(packet_id), entry);
+        entry->field = NULL;
+        entry->compiled = 0;
+        entry->types = types;
+        entry->is_je = is_je;
+        entry->settings = settings;
+#ifdef MC_DISSECTOR_AOT_DECODERS
+        entry->aot_name = wmem_strdup_printf(schema_scope, "%s/%s/%s", set_name, side, packet_name);
+#endif // MC_DISSECTOR_AOT_DECODERS
+        packet_table->entries[packet_id] = entry;
 
         gchar *packet_definition = g_strconcat("packet_", packet_name, NULL);
-        cJSON *item = cJSON_GetObjectItem(data, packet_definition);
-
-        if (item != NULL) {
-            wmem_list_t *path_array = wmem_list_new(wmem_epan_scope());
-            wmem_list_append(path_array, 0);
-            entry->field = parse_protocol(path_array, packet_name, wmem_list_new(wmem_epan_scope()),
-                                          wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal),
-                                          item, types, is_je, true, settings);
-        } else {
-            protocol_field field = wmem_new(wmem_epan_scope(), protocol_field_t);
-            field->make_tree = make_tree_void;
-            entry->field = field;
-        }
+        entry->definition = schema_get(data, packet_definition);
         g_free(packet_definition);
+    }
+    g_free(packet_ids);
+}
 
-        now = now->next;
+// Binds the decoders of a compiled or loaded field
+void finish_protocol_entry(protocol_entry entry) {
+    if (entry->field == NULL) {
+        entry->make_tree = NULL;
+        entry->program = NULL;
+        g_atomic_int_set(&entry->compiled, 1);
+        WS_LOG("Can't compile packet %s", entry->name);
+        return;
     }
+    entry->make_tree = entry->field->make_tree;
+#ifdef MC_DISSECTOR_AOT_DECODERS
+    const aot_decoder *decoder = wmem_map_lookup(aot_decoder_map, entry->aot_name);
+    if (decoder != NULL && entry->definition != NULL && decoder->check(entry->field))
+        entry->make_tree = decoder->make_tree;
+#endif // MC_DISSECTOR_AOT_DECODERS
+    // Generated decoders are preferred, then bytecode, the tree interpreter is kept for BE
+    entry->program = entry->make_tree == entry->field->make_tree && entry->is_je ? vm_compile(entry->field) : NULL;
+    g_atomic_int_set(&entry->compiled, 1);
+    WS_LOG("Compiled packet %s with %s decoder, %u fields interned, %u deduplicated, %u programs, %u instructions",
+           entry->name, entry->program != NULL ? "bytecode" : entry->make_tree != entry->field->make_tree ? "AOT" : "tree",
+           interned_field_count, deduplicated_field_count, vm_get_program_count(), vm_get_instruction_count());
 }
 
-protocol_set create_protocol_set(cJSON *types, cJSON *data, bool is_je, protocol_settings settings) {
-    protocol_set set = wmem_new(wmem_epan_scope(), protocol_set_t);
-    set->client_packet_map = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
-    set->server_packet_map = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
-    set->client_name_map = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
-    set->server_name_map = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
+void compile_protocol_entry(protocol_entry entry) {
+    if (entry->definition != NULL) {
+        wmem_list_t *path_array = wmem_list_new(schema_scope);
+        wmem_list_append(path_array, 0);
+        entry->field = parse_protocol(path_array, entry->name, wmem_list_new(schema_scope),
+                                      wmem_map_new(schema_scope, g_str_hash, g_str_equal),
+                                      entry->definition, entry->types, entry->is_je, true, entry->settings);
+    } else {
+        protocol_field field = wmem_new0(schema_scope, protocol_field_t);
+        field->make_tree = make_tree_void;
+        entry->field = field;
+    }
+    finish_protocol_entry(entry);
+}
+
+void load_cached_entry(bool is_client, guint packet_id, protocol_field field, gpointer user_data) {
+    protocol_packets *packets = is_client ? &((protocol_set) user_data)->client_packets
+                                          : &((protocol_set) user_data)->server_packets;
+    protocol_entry entry = packet_id < packets->size ? packets->entries[packet_id] : NULL;
+    if (entry == NULL || g_atomic_int_get(&entry->compiled))
+        return;
+    entry->field = field;
+    finish_protocol_entry(entry);
+}
+
+protocol_set create_protocol_set(schema_node types, schema_node data, gchar *name, bool is_je,
+                                 protocol_settings settings) {
+    protocol_set set = wmem_new(schema_scope, protocol_set_t);
 
-    cJSON *to_client = cJSON_GetObjectItem(cJSON_GetObjectItem(data, "toClient"), "types");
-    cJSON *to_server = cJSON_GetObjectItem(cJSON_GetObjectItem(data, "toServer"), "types");
-    make_simple_protocol(to_client, types, set->client_packet_map, set->client_name_map, is_je, settings);
-    make_simple_protocol(to_server, types, set->server_packet_map, set->server_name_map, is_je, settings);
+    schema_node to_client = schema_get(schema_get(data, "toClient"), "types");
+    schema_node to_server = schema_get(schema_get(data, "toServer"), "types");
+    make_simple_protocol(to_client, types, &set->client_packets, is_je, settings, name, "c");
+    make_simple_protocol(to_server, types, &set->server_packets, is_je, settings, name, "s");
 
+    set->name = wmem_strdup(schema_scope, name);
+    set->changed = false;
+    load_schema_cache(name, is_je, load_cached_entry, set);
+    wmem_list_append(protocol_sets, set);
     return set;
 }
 
@@ -909,21 +1399,112 @@ gint get_packet_id_by_entry(protocol_entry entry) {
 }
 
 gint get_packet_id(protocol_set set, gchar *name, bool is_client) {
-    wmem_map_t *name_map = is_client ? set->client_name_map : set->server_name_map;
+    wmem_map_t *name_map = is_client ? set->client_packets.name_map : set->server_packets.name_map;
     return GPOINTER_TO_INT(wmem_map_lookup(name_map, name)) - 1;
 }
 
 protocol_entry get_protocol_entry(protocol_set set, guint packet_id, bool is_client) {
-    wmem_map_t *packet_map = is_client ? set->client_packet_map : set->server_packet_map;
-    return wmem_map_lookup(packet_map, GUINT_TO_POINTER(packet_id));
+    protocol_packets *packets = is_client ? &set->client_packets : &set->server_packets;
+    if (packet_id >= packets->size)
+        return NULL;
+    protocol_entry entry = packets->entries[packet_id];
+    if (entry != NULL && !g_atomic_int_get(&entry->compiled)) {
+        lock_schema();
+        if (!entry->compiled) {
+            compile_protocol_entry(entry);
+            set->changed = true;
+        }
+        unlock_schema();
+    }
+    return entry;
+}
+
+bool compile_protocol_packets(protocol_set set, protocol_packets *packets, gint *stop) {
+    for (guint i = 0; i < packets->size; i++) {
+        protocol_entry entry = packets->entries[i];
+        if (g_atomic_int_get(stop))
+            return false;
+        if (entry == NULL || g_atomic_int_get(&entry->compiled))
+            continue;
+        lock_schema();
+        if (!entry->compiled) {
+            compile_protocol_entry(entry);
+            set->changed = true;
+        }
+        unlock_schema();
+    }
+    return true;
+}
+
+// Packets that are not compiled yet are left out, they are compiled on their first use after loading
+bool add_cached_packets(schema_cache_writer writer, protocol_packets *packets, bool is_client) {
+    for (guint i = 0; i < packets->size; i++) {
+        protocol_entry entry = packets->entries[i];
+        if (entry != NULL && entry->compiled && !schema_cache_writer_add(writer, is_client, i, entry->field))
+            return false;
+    }
+    return true;
+}
+
+// Needs the schema lock, the file holds every packet compiled so far so the next start loads them instead of
+// parsing them again
+void save_protocol_set(protocol_set set) {
+    if (!set->changed)
+        return;
+    schema_cache_writer writer = schema_cache_writer_new();
+    if (add_cached_packets(writer, &set->client_packets, true) &&
+        add_cached_packets(writer, &set->server_packets, false))
+        schema_cache_writer_save(writer, set->name);
+    else
+        schema_cache_writer_free(writer);
+    set->changed = false;
+}
+
+void save_protocol_sets() {
+    lock_schema();
+    for (wmem_list_frame_t *frame = wmem_list_head(protocol_sets); frame != NULL; frame = wmem_list_frame_next(frame))
+        save_protocol_set(wmem_list_frame_data(frame));
+    unlock_schema();
+}
+
+void compile_protocol_set(protocol_set set, gint *stop) {
+    if (!compile_protocol_packets(set, &set->client_packets, stop) ||
+        !compile_protocol_packets(set, &set->server_packets, stop))
+        return;
+    lock_schema();
+    save_protocol_set(set);
+    unlock_schema();
 }
 
 bool make_tree(protocol_entry entry, proto_tree *tree, tvbuff_t *tvb, extra_data *extra, const guint8 *data,
                guint remaining) {
     if (entry->field != NULL) {
-        data_recorder recorder = create_data_recorder();
-        guint len = entry->field->make_tree(data, tree, tvb, extra, entry->field, 1, remaining - 1, recorder);
-        destroy_data_recorder(recorder);
+        guint len = 0;
+#ifdef DEBUG
+        gint allocations = g_atomic_int_get(&decode_heap_allocations);
+#ifdef MC_DISSECTOR_CHECK_ALLOCATIONS
+        bool decoded_before = check_decoded_before(entry, tree, data, remaining);
+#endif // MC_DISSECTOR_CHECK_ALLOCATIONS
+#endif // DEBUG
+        data_recorder recorder = get_thread_recorder();
+        lock_schema_shared(); // only keeps compiling out, decoders don't write compiled fields
+        TRY {
+            record_reset(recorder);
+            len = entry->program != NULL ?
+                  vm_execute(entry->program, data, tree, tvb, extra, 1, remaining - 1, recorder) :
+                  entry->make_tree(data, tree, tvb, extra, entry->field, 1, remaining - 1, recorder);
+        } FINALLY {
+            unlock_schema_shared();
+        } ENDTRY;
+#ifdef DEBUG
+        allocations = g_atomic_int_get(&decode_heap_allocations) - allocations;
+        if (allocations != 0)
+            WS_LOG("Decoding packet %s made %d heap allocations", entry->name, allocations);
+#ifdef MC_DISSECTOR_CHECK_ALLOCATIONS
+        // Everything the same packet needs with the same kind of tree was grown when it was decoded first
+        g_assert(!decoded_before || allocations == 0);
+#endif // MC_DISSECTOR_CHECK_ALLOCATIONS
+#endif // DEBUG
         if (len != remaining - 1)
             proto_tree_add_string_format_value(tree, hf_invalid_data_je, tvb, 1, remaining - 1,
                                                "length mismatch", "Packet length mismatch, expected %d, got %d", len,
@@ -6,7 +6,7 @@
 #define MC_DISSECTOR_PROTOCOL_SCHEMA_H
 
 #include <epan/proto.h>
-#include "cJSON/cJSON.h"
+#include "binary_schema.h"
 #include "data_recorder.h"
 
 typedef struct _protocol_set protocol_set_t, *protocol_set;
@@ -18,12 +18,82 @@ typedef struct {
     bool visited;
 } extra_data;
 
+// Sorted by key so cases can be found with a binary search
+typedef struct {
+    gchar *key;
+    void *value;
+} protocol_case;
+
+// Integer view of a case table when every key is an integer, dense when the keys are close together
+typedef struct {
+    bool available;
+    gint64 min;
+    guint range; // length of dense, 0 if the keys are sparse
+    void **dense;
+    guint size;
+    gint64 *keys;
+    void **values;
+} protocol_int_cases;
+
 struct _protocol_field {
     bool hf_resolved;
     gchar *name;
+    record_slot slot; // name when it was compiled, used to record the value
     gchar *display_name;
     int hf_index;
-    wmem_map_t *additional_info;
+
+    union {
+        struct {
+            guint size;
+            bool on_top;
+            protocol_field *children;
+        } container;
+        struct {
+            protocol_field sub_field;
+        } option, top_bit_set_terminated_array;
+        struct {
+            guint length;
+        } buffer;
+        struct {
+            protocol_field sub_field;
+            guint size;
+            protocol_case *mappings;
+            protocol_int_cases int_mappings;
+        } mapper;
+        struct {
+            protocol_field sub_field;
+            record_path count_path; // NULL if prefixed by a varint
+            guint element_width; // bytes of every element if they are numbers of the same size, 0 otherwise
+        } array;
+        struct {
+            guint size;
+            guint total_bytes;
+            guint8 *bits;
+            bool *signed_;
+            gchar **names;
+            record_slot *slots;
+            int *const *hf_indexes;
+        } bitfield;
+        struct {
+            record_path path;
+            protocol_field default_field;
+            guint size;
+            protocol_case *cases;
+            protocol_int_cases int_cases;
+        } switch_;
+        struct {
+            protocol_field sub_field;
+            guint8 end_val;
+        } entity_metadata_loop;
+        struct {
+            protocol_field sub_field;
+            guint size;
+            gchar **names;
+            gchar **aliases;
+            record_slot *name_slots;
+            record_slot *alias_slots;
+        } basic_type;
+    };
 
     guint (*make_tree)(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
                        protocol_field field, guint offset, guint remaining, data_recorder recorder);
@@ -31,11 +101,38 @@ struct _protocol_field {
 
 typedef struct {
     bool nbt_any_type;
+    bool chunk_sections; // chunk data is made of sections with paletted biomes, since 1.18
+    bool chunk_long_counts; // paletted containers send the count of their longs, until 1.21.5
 } protocol_settings;
 
 void init_schema_data();
 
-protocol_set create_protocol_set(cJSON *types, cJSON *data, bool is_je, protocol_settings settings);
+// Allocator of compiled schemas, only used with the schema lock held
+wmem_allocator_t *get_schema_scope();
+
+// Held alone to compile, compiled fields are not written after that
+void lock_schema();
+
+void unlock_schema();
+
+// Held by decoders, any number of them can decode with the same protocol set
+void lock_schema_shared();
+
+void unlock_schema_shared();
+
+// Label of the element at the index, used while decoding
+gchar *get_element_label(guint index);
+
+// Arrays show at most this many elements in the tree, the rest are still decoded. 0 shows all of them
+void set_array_element_limit(guint limit);
+
+// name is "version/state", used to find generated decoders
+protocol_set create_protocol_set(schema_node types, schema_node data, gchar *name, bool is_je,
+                                 protocol_settings settings);
+
+guint get_interned_field_count();
+
+guint get_deduplicated_field_count();
 
 gchar *get_packet_name(protocol_entry entry);
 
@@ -45,6 +142,13 @@ gint get_packet_id(protocol_set set, gchar *name, bool is_client);
 
 protocol_entry get_protocol_entry(protocol_set set, guint packet_id, bool is_client);
 
+// Compiles every packet in the set ahead of its first lookup, returns early once stop is set.
+// A fully compiled set is saved to its cache at once
+void compile_protocol_set(protocol_set set, gint *stop);
+
+// Saves the cache of every set that compiled packets since it was loaded, called when a capture is closed
+void save_protocol_sets();
+
 bool make_tree(protocol_entry entry, proto_tree *tree, tvbuff_t *tvb, extra_data *extra, const guint8 *data,
                guint remaining);
 
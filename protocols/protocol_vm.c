@@ -0,0 +1,467 @@
+#include <string.h>
+#include "protocol_vm.h"
+#include "protocol_functions.h"
+#include "protocol_data.h"
+#include "protocol_je/je_dissect.h"
+
+// Containers and bodies are inlined into their parent program until it reaches this size, then they are called
+#define VM_INLINE_LIMIT 512
+#define VM_INITIAL_STACK 32
+
+#if defined(__GNUC__)
+#define VM_THREADED_DISPATCH
+#endif
+
+enum {
+    VM_RETURN,
+    VM_VAR_INT,
+    VM_FIELD,
+    VM_RECORD_START,
+    VM_PUSH_CONTAINER,
+    VM_POP_CONTAINER,
+    VM_PREPASS_BEGIN,
+    VM_PREPASS_END,
+    VM_CALL,
+    VM_OPTION,
+    VM_ARRAY_BEGIN,
+    VM_ARRAY_NEXT,
+    VM_LOOP_BEGIN,
+    VM_LOOP_NEXT,
+    VM_SWITCH
+};
+
+typedef struct {
+    guint op;
+    guint target;       // jump target in the same program
+    protocol_field field;
+    vm_program program; // callee of VM_CALL
+} vm_instruction;
+
+struct _vm_program {
+    vm_instruction *code;
+    guint size;
+};
+
+enum {
+    FRAME_CALL,
+    FRAME_SWITCH,
+    FRAME_CONTAINER,
+    FRAME_PREPASS,
+    FRAME_ARRAY,
+    FRAME_LOOP
+};
+
+typedef struct {
+    guint kind;
+    vm_program program; // return address of calls and switches
+    guint pc;
+    protocol_field field;
+    proto_tree *tree;   // tree to restore when the frame is popped
+    guint offset;
+    guint remaining;
+    guint index;
+    guint count;
+    proto_tree *shown_tree; // subtree of an array while its hidden elements are decoded
+    guint hidden_offset;
+} vm_frame;
+
+wmem_map_t *vm_program_map = NULL;
+guint vm_program_count = 0;
+guint vm_instruction_count = 0;
+
+void init_protocol_vm() {
+    vm_program_map = wmem_map_new(get_schema_scope(), g_direct_hash, g_direct_equal);
+}
+
+guint vm_get_program_count() {
+    return vm_program_count;
+}
+
+guint vm_get_instruction_count() {
+    return vm_instruction_count;
+}
+
+// ---------------------------------- Compiler ----------------------------------
+
+guint vm_emit(GArray *code, guint op, protocol_field field) {
+    vm_instruction instruction = {op, 0, field, NULL};
+    g_array_append_val(code, instruction);
+    return code->len - 1;
+}
+
+#define VM_AT(code, index) g_array_index(code, vm_instruction, index)
+
+void vm_emit_field(GArray *code, protocol_field field);
+
+void vm_emit_body(GArray *code, protocol_field field) {
+    if (code->len < VM_INLINE_LIMIT) {
+        vm_emit_field(code, field);
+        return;
+    }
+    guint call = vm_emit(code, VM_CALL, field);
+    VM_AT(code, call).program = vm_compile(field);
+}
+
+void vm_emit_container(GArray *code, protocol_field field) {
+    bool not_top = !field->container.on_top;
+    if (not_top)
+        vm_emit(code, VM_PUSH_CONTAINER, field);
+    for (guint i = 0; i < field->container.size; i++) {
+        protocol_field sub_field = field->container.children[i];
+        if (sub_field->slot == RECORD_SLOT_UNNAMED && not_top) {
+            vm_emit(code, VM_PREPASS_BEGIN, sub_field);
+            vm_emit_body(code, sub_field);
+            vm_emit(code, VM_PREPASS_END, sub_field);
+        }
+        vm_emit(code, VM_RECORD_START, sub_field);
+        vm_emit_body(code, sub_field);
+    }
+    if (not_top)
+        vm_emit(code, VM_POP_CONTAINER, field);
+}
+
+void vm_emit_loop(GArray *code, guint begin_op, guint next_op, protocol_field field, protocol_field sub_field) {
+    guint begin = vm_emit(code, begin_op, field);
+    guint body = code->len;
+    vm_emit_body(code, sub_field);
+    guint next = vm_emit(code, next_op, field);
+    VM_AT(code, begin).target = next;
+    VM_AT(code, next).target = body;
+}
+
+void vm_emit_field(GArray *code, protocol_field field) {
+    if (field->make_tree == make_tree_je_container) {
+        vm_emit_container(code, field);
+    } else if (field->make_tree == make_tree_option) {
+        guint option = vm_emit(code, VM_OPTION, field);
+        vm_emit_body(code, field->option.sub_field);
+        VM_AT(code, option).target = code->len;
+    } else if (field->make_tree == make_tree_je_array) {
+        vm_emit_loop(code, VM_ARRAY_BEGIN, VM_ARRAY_NEXT, field, field->array.sub_field);
+    } else if (field->make_tree == make_tree_je_entity_metadata_loop) {
+        vm_emit_loop(code, VM_LOOP_BEGIN, VM_LOOP_NEXT, field, field->entity_metadata_loop.sub_field);
+    } else if (field->make_tree == make_tree_switch) {
+        // Cases are compiled here, so running a program never compiles
+        for (guint i = 0; i < field->switch_.size; i++)
+            vm_compile(field->switch_.cases[i].value);
+        if (field->switch_.default_field != NULL)
+            vm_compile(field->switch_.default_field);
+        vm_emit(code, VM_SWITCH, field);
+    } else if (field->make_tree == make_tree_var_int) {
+        vm_emit(code, VM_VAR_INT, field);
+    } else {
+        vm_emit(code, VM_FIELD, field);
+    }
+}
+
+vm_program vm_compile(protocol_field field) {
+    vm_program program = wmem_map_lookup(vm_program_map, field);
+    if (program != NULL)
+        return program;
+    GArray *code = g_array_new(false, false, sizeof(vm_instruction));
+    vm_emit_field(code, field);
+    vm_emit(code, VM_RETURN, NULL);
+
+    program = wmem_new(get_schema_scope(), vm_program_t);
+    program->size = code->len;
+    program->code = wmem_memdup(get_schema_scope(), code->data, code->len * sizeof(vm_instruction));
+    g_array_free(code, true);
+    wmem_map_insert(vm_program_map, field, program);
+    vm_program_count++;
+    vm_instruction_count += program->size;
+    return program;
+}
+
+// ---------------------------------- Interpreter ----------------------------------
+
+#define ADVANCE(length) { \
+    guint advance = (length); \
+    offset += advance; \
+    remaining -= advance; \
+}
+
+#define START_ELEMENT(frame) record_start_element(recorder, tree ? get_element_label((frame)->index) : NULL);
+
+vm_frame *vm_push_frame(vm_frame **stack, guint *capacity, guint *depth) {
+    if (*depth == *capacity) {
+        vm_frame *grown = wmem_alloc_array(wmem_packet_scope(), vm_frame, *capacity * 2);
+        memcpy(grown, *stack, *capacity * sizeof(vm_frame));
+        *stack = grown;
+        *capacity *= 2;
+    }
+    return *stack + (*depth)++;
+}
+
+guint vm_execute(vm_program program, const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                 guint offset, guint remaining, data_recorder recorder) {
+    vm_frame initial_stack[VM_INITIAL_STACK];
+    vm_frame *stack = initial_stack;
+    guint capacity = VM_INITIAL_STACK;
+    guint depth = 0;
+    guint start = offset;
+    guint pc = 0;
+    vm_instruction *instruction;
+    vm_frame *frame;
+    protocol_field field;
+
+#define PUSH_FRAME(frame_kind) \
+    frame = vm_push_frame(&stack, &capacity, &depth); \
+    frame->kind = frame_kind;
+#define TOP_FRAME (stack + depth - 1)
+
+#ifdef VM_THREADED_DISPATCH
+    static void *dispatch_table[] = {
+            [VM_RETURN] = &&op_VM_RETURN,
+            [VM_VAR_INT] = &&op_VM_VAR_INT,
+            [VM_FIELD] = &&op_VM_FIELD,
+            [VM_RECORD_START] = &&op_VM_RECORD_START,
+            [VM_PUSH_CONTAINER] = &&op_VM_PUSH_CONTAINER,
+            [VM_POP_CONTAINER] = &&op_VM_POP_CONTAINER,
+            [VM_PREPASS_BEGIN] = &&op_VM_PREPASS_BEGIN,
+            [VM_PREPASS_END] = &&op_VM_PREPASS_END,
+            [VM_CALL] = &&op_VM_CALL,
+            [VM_OPTION] = &&op_VM_OPTION,
+            [VM_ARRAY_BEGIN] = &&op_VM_ARRAY_BEGIN,
+            [VM_ARRAY_NEXT] = &&op_VM_ARRAY_NEXT,
+            [VM_LOOP_BEGIN] = &&op_VM_LOOP_BEGIN,
+            [VM_LOOP_NEXT] = &&op_VM_LOOP_NEXT,
+            [VM_SWITCH] = &&op_VM_SWITCH
+    };
+#define VM_CASE(op) op_##op:
+#define VM_NEXT() \
+    instruction = program->code + pc++; \
+    field = instruction->field; \
+    goto *dispatch_table[instruction->op];
+
+    VM_NEXT()
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() goto dispatch;
+
+    dispatch:
+    instruction = program->code + pc++;
+    field = instruction->field;
+    switch (instruction->op) {
+#endif
+
+    VM_CASE(VM_RETURN)
+    {
+        if (depth == 0)
+            return offset - start;
+        frame = stack + --depth;
+        program = frame->program;
+        pc = frame->pc;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_VAR_INT)
+    {
+        guint result;
+        gint length = read_var_int(data + offset, remaining, &result);
+        CHECK_READ(length)
+        if (tree)
+            proto_tree_add_uint(tree, field->hf_index, tvb, offset, length, record_uint(recorder, result));
+        else
+            record_uint(recorder, result);
+        ADVANCE(length)
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_FIELD)
+    {
+        ADVANCE(field->make_tree(data, tree, tvb, extra, field, offset, remaining, recorder))
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_RECORD_START)
+    {
+        record_start(recorder, field->slot);
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_PUSH_CONTAINER)
+    {
+        PUSH_FRAME(FRAME_CONTAINER)
+        frame->tree = tree;
+        frame->offset = offset;
+        gchar *label = record_take_label(recorder, field->display_name);
+        record_push(recorder);
+        if (tree)
+            tree = proto_tree_add_subtree(tree, tvb, offset, remaining, ett_sub_je, NULL, label);
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_POP_CONTAINER)
+    {
+        frame = stack + --depth;
+        proto_item_set_len(proto_tree_get_parent(tree), offset - frame->offset);
+        record_pop(recorder);
+        tree = frame->tree;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_PREPASS_BEGIN)
+    {
+        record_start(recorder, RECORD_SLOT_SAME);
+        PUSH_FRAME(FRAME_PREPASS)
+        frame->tree = tree;
+        frame->offset = offset;
+        frame->remaining = remaining;
+        tree = NULL;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_PREPASS_END)
+    {
+        frame = stack + --depth;
+        tree = frame->tree;
+        offset = frame->offset;
+        remaining = frame->remaining;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_CALL)
+    {
+        PUSH_FRAME(FRAME_CALL)
+        frame->program = program;
+        frame->pc = pc;
+        program = instruction->program;
+        pc = 0;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_OPTION)
+    {
+        CHECK_LENGTH(1)
+        bool is_present = tvb_get_guint8(tvb, offset) != 0;
+        record_drop_label(recorder);
+        ADVANCE(1)
+        if (!is_present)
+            pc = instruction->target;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_ARRAY_BEGIN)
+    {
+        gchar *label = record_take_label(recorder, field->display_name);
+        guint len = 0;
+        guint data_count = 0;
+        gint64 count;
+        if (field->array.count_path == NULL) {
+            gint read = read_var_int(data + offset, remaining, &data_count);
+            CHECK_READ(read)
+            len = read;
+        } else if (record_query_int(recorder, field->array.count_path, &count)) {
+            CHECK_COUNT(count)
+            data_count = (guint) count;
+        }
+        PUSH_FRAME(FRAME_ARRAY)
+        frame->field = field;
+        frame->tree = tree;
+        frame->offset = offset;
+        frame->index = -1;
+        frame->count = data_count;
+        frame->shown_tree = NULL;
+        if (tree) {
+            tree = proto_tree_add_subtree(tree, tvb, offset, remaining, ett_sub_je, NULL, label);
+            proto_tree_add_uint(tree, hf_array_length_je, tvb, offset, len, data_count);
+        }
+        ADVANCE(len)
+        if (tree == NULL && field->array.sub_field->make_tree == make_tree_var_int) {
+            gint skipped = skip_var_ints(data + offset, remaining, data_count);
+            if (!is_invalid(skipped)) {
+                ADVANCE(skipped)
+                frame->count = 0;
+            }
+        }
+        if (field->array.element_width != 0) {
+            gint elements_length = make_tree_fixed_width_elements(data, tree, tvb, extra, field, offset, remaining,
+                                                                   data_count, recorder, true);
+            if (!is_invalid(elements_length)) {
+                ADVANCE(elements_length)
+                frame->count = 0;
+            }
+        }
+        pc = instruction->target;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_ARRAY_NEXT)
+    {
+        frame = TOP_FRAME;
+        if (++frame->index < frame->count) {
+            if (tree && frame->index == get_shown_element_count(frame->count)) {
+                // The rest are decoded without a tree
+                frame->shown_tree = tree;
+                frame->hidden_offset = offset;
+                tree = NULL;
+            }
+            START_ELEMENT(frame)
+            pc = instruction->target;
+            VM_NEXT()
+        }
+        if (frame->shown_tree) {
+            tree = frame->shown_tree;
+            add_hidden_elements(tree, tvb, frame->count - get_shown_element_count(frame->count),
+                                frame->hidden_offset, offset - frame->hidden_offset, true);
+        }
+        if (frame->tree)
+            proto_item_set_len(tree, offset - frame->offset);
+        tree = frame->tree;
+        depth--;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_LOOP_BEGIN)
+    {
+        gchar *label = record_take_label(recorder, field->display_name);
+        PUSH_FRAME(FRAME_LOOP)
+        frame->field = field;
+        frame->tree = tree;
+        frame->offset = offset;
+        frame->index = -1;
+        if (tree)
+            tree = proto_tree_add_subtree(tree, tvb, offset, remaining, ett_sub_je, NULL, label);
+        pc = instruction->target;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_LOOP_NEXT)
+    {
+        frame = TOP_FRAME;
+        CHECK_LENGTH(1)
+        if (data[offset] != field->entity_metadata_loop.end_val) {
+            frame->index++;
+            START_ELEMENT(frame)
+            pc = instruction->target;
+            VM_NEXT()
+        }
+        ADVANCE(1)
+        if (frame->tree)
+            proto_item_set_len(tree, offset - frame->offset);
+        tree = frame->tree;
+        depth--;
+        VM_NEXT()
+    }
+
+    VM_CASE(VM_SWITCH)
+    {
+        protocol_field sub_field_choose = select_switch_case(field, recorder);
+        if (sub_field_choose == NULL) { // no case matched
+            VM_NEXT()
+        }
+        record_pass_label(recorder, field->display_name);
+        PUSH_FRAME(FRAME_SWITCH)
+        frame->program = program;
+        frame->pc = pc;
+        program = wmem_map_lookup(vm_program_map, sub_field_choose);
+        pc = 0;
+        VM_NEXT()
+    }
+
+#ifndef VM_THREADED_DISPATCH
+        default:
+            return offset - start;
+    }
+#endif
+}
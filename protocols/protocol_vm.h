@@ -0,0 +1,22 @@
+#ifndef MC_DISSECTOR_PROTOCOL_VM_H
+#define MC_DISSECTOR_PROTOCOL_VM_H
+
+#include "protocol_schema.h"
+
+// Compiled fields lowered to linear bytecode, run by a loop with an explicit frame stack instead of recursing
+// through make_tree. Containers, arrays, loops, options and switches are lowered, other fields are called as
+// single instructions.
+typedef struct _vm_program vm_program_t, *vm_program;
+
+void init_protocol_vm();
+
+vm_program vm_compile(protocol_field field);
+
+guint vm_execute(vm_program program, const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                 guint offset, guint remaining, data_recorder recorder);
+
+guint vm_get_program_count();
+
+guint vm_get_instruction_count();
+
+#endif //MC_DISSECTOR_PROTOCOL_VM_H
@@ -2,7 +2,10 @@
 // Created by Nickid2018 on 2023/7/13.
 //
 
+#include <string.h>
+#include <wsutil/wslog.h>
 #include "protocols.h"
+#include "mc_dissector.h"
 #include "protocolVersions.h"
 #include "protocolSchemas.h"
 
@@ -12,6 +15,8 @@ wmem_map_t *data_version_rev_map_je = NULL;
 GArray *data_version_list_je = NULL;
 wmem_map_t *protocol_raw_map_je = NULL;
 wmem_map_t *protocol_schema_je = NULL;
+GThread *warm_up_thread_je = NULL;
+gint warm_up_stop_je = 0;
 
 gint compare_int(gconstpointer a, gconstpointer b) {
     return *(gint *) (a) - *(gint *) (b);
@@ -23,21 +28,21 @@ void init_je() {
     data_version_map_je = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
     data_version_rev_map_je = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
     protocol_version_map_je = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
-    cJSON *json = cJSON_Parse(PROTOCOL_VERSIONS_JE);
-    int size = cJSON_GetArraySize(json);
-    for (int i = 0; i < size; i++) {
-        cJSON *item = cJSON_GetArrayItem(json, i);
-        if (cJSON_GetObjectItem(item, "usesNetty")->valueint == 0)
+    schema_node json = schema_root(PROTOCOL_VERSIONS_JE);
+    guint size = schema_size(json);
+    for (guint i = 0; i < size; i++) {
+        schema_node item = schema_at(json, i);
+        if (schema_int(schema_get(item, "usesNetty")) == 0)
             continue;
-        cJSON *version = cJSON_GetObjectItem(item, "version");
+        schema_node version = schema_get(item, "version");
         if (version == NULL)
             continue;
-        guint protocol_version = (guint) version->valueint;
-        cJSON *data_version_obj = cJSON_GetObjectItem(item, "dataVersion");
+        guint protocol_version = (guint) schema_int(version);
+        schema_node data_version_obj = schema_get(item, "dataVersion");
         if (data_version_obj == NULL)
             continue;
-        gint data_version = data_version_obj->valueint;
-        gchar *name = g_strdup(cJSON_GetObjectItem(item, "minecraftVersion")->valuestring);
+        gint data_version = schema_int(data_version_obj);
+        gchar *name = (gchar *) schema_string(schema_get(item, "minecraftVersion"));
         wmem_list_t *map_values = wmem_map_lookup(protocol_version_map_je, GUINT_TO_POINTER(protocol_version));
         if (map_values == NULL) {
             map_values = wmem_list_new(wmem_epan_scope());
@@ -47,20 +52,17 @@ void init_je() {
         wmem_map_insert(data_version_map_je, name, GINT_TO_POINTER(data_version + 1));
         wmem_map_insert(data_version_rev_map_je, GINT_TO_POINTER(data_version), name);
     }
-    cJSON_Delete(json);
 
     data_version_list_je = g_array_new(FALSE, FALSE, sizeof(guint));
-    protocol_schema_je = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
+    protocol_schema_je = wmem_map_new(get_schema_scope(), g_str_hash, g_str_equal);
     protocol_raw_map_je = wmem_map_new(wmem_epan_scope(), g_str_hash, g_str_equal);
     for (int i = 0; i < JE_PROTOCOL_SIZE; i++) {
-        const char *name = JE_PROTOCOLS[i * 2];
-        const char *raw = JE_PROTOCOLS[i * 2 + 1];
-        gchar *g_name = g_strdup(name);
-        gint data_version = get_java_data_version_unchecked(g_name);
+        gchar *name = (gchar *) JE_PROTOCOLS[i].name;
+        gint data_version = get_java_data_version_unchecked(name);
         if (data_version == -1)
             continue;
         g_array_append_val(data_version_list_je, data_version);
-        wmem_map_insert(protocol_raw_map_je, g_name, g_strdup(raw));
+        wmem_map_insert(protocol_raw_map_je, name, (gpointer) schema_root(JE_PROTOCOLS[i].root));
     }
     g_array_sort(data_version_list_je, compare_int);
 }
@@ -110,87 +112,140 @@ guint find_nearest_java_protocol(guint data_version) {
     return g_array_index(data_version_list_je, guint, data_version_list_je->len - 1);
 }
 
-protocol_je_set get_protocol_je_set(gchar *java_version) {
+typedef struct {
+    je_state state;
+    bool is_client;
+    gchar *packet_name;
+    je_state next_state;
+    bool both_sides;
+} je_state_transition_definition;
+
+// Login success leads to configuration since 1.20.2, to play for both sides before
+const je_state_transition_definition JE_TRANSITIONS[] = {
+        {LOGIN,         true,  "success",                       PLAY,          true},
+        {LOGIN,         false, "login_acknowledgement",         CONFIGURATION, false},
+        {PLAY,          true,  "start_configuration",           CONFIGURATION, false},
+        {PLAY,          false, "configuration_acknowledgement", CONFIGURATION, false},
+        {CONFIGURATION, true,  "finish_configuration",          PLAY,          false},
+        {CONFIGURATION, false, "finish_configuration",          PLAY,          false}
+};
+
+void resolve_je_transitions(protocol_je_set set) {
+    for (guint state = 0; state < INVALID; state++)
+        for (guint side = 0; side < 2; side++)
+            set->transitions[state][side].packet_id = -1;
+    for (guint i = 0; i < sizeof(JE_TRANSITIONS) / sizeof(je_state_transition_definition); i++) {
+        const je_state_transition_definition *definition = JE_TRANSITIONS + i;
+        protocol_set state_set = definition->state == LOGIN ? set->login :
+                                 definition->state == PLAY ? set->play : set->configuration;
+        if (state_set == NULL)
+            continue;
+        je_state_transition *transition = &set->transitions[definition->state][definition->is_client];
+        transition->packet_id = get_packet_id(state_set, definition->packet_name, definition->is_client);
+        transition->next_state = definition->next_state;
+        transition->both_sides = definition->both_sides;
+        if (definition->state == LOGIN && definition->is_client && set->configuration != NULL) {
+            transition->next_state = CONFIGURATION;
+            transition->both_sides = false;
+        }
+    }
+}
+
+protocol_je_set get_protocol_je_set_locked(gchar *java_version) {
     protocol_je_set cached = wmem_map_lookup(protocol_schema_je, java_version);
     if (cached != NULL)
         return cached;
-    gchar *raw = wmem_map_lookup(protocol_raw_map_je, java_version);
-    if (raw == NULL)
+    schema_node json = wmem_map_lookup(protocol_raw_map_je, java_version);
+    if (json == NULL)
         return NULL;
-    cJSON *json = cJSON_Parse(raw);
-    cJSON *types = cJSON_GetObjectItem(json, "types");
-    cJSON *login = cJSON_GetObjectItem(json, "login");
-    cJSON *play = cJSON_GetObjectItem(json, "play");
-    cJSON *config = cJSON_GetObjectItem(json, "configuration");
+    schema_node types = schema_get(json, "types");
+    schema_node login = schema_get(json, "login");
+    schema_node play = schema_get(json, "play");
+    schema_node config = schema_get(json, "configuration");
 
     protocol_settings settings = {
-            get_java_data_version(java_version) >= 3567
+            get_java_data_version(java_version) >= 3567,
+            get_java_data_version(java_version) >= 2860,
+            get_java_data_version(java_version) < 4325
     };
 
-    protocol_je_set result = wmem_new(wmem_epan_scope(), struct _protocol_je_set);
-    protocol_set login_set = create_protocol_set(types, login, true, settings);
-    protocol_set play_set = create_protocol_set(types, play, true, settings);
+    protocol_je_set result = wmem_new0(get_schema_scope(), struct _protocol_je_set);
+    protocol_set login_set = create_protocol_set(types, login,
+                                                 wmem_strconcat(get_schema_scope(), java_version, "/login", NULL),
+                                                 true, settings);
+    protocol_set play_set = create_protocol_set(types, play,
+                                                wmem_strconcat(get_schema_scope(), java_version, "/play", NULL),
+                                                true, settings);
     result->login = login_set;
     result->play = play_set;
     if (config != NULL) {
-        protocol_set config_set = create_protocol_set(types, config, true, settings);
+        protocol_set config_set = create_protocol_set(types, config,
+                                                      wmem_strconcat(get_schema_scope(), java_version,
+                                                                     "/configuration", NULL),
+                                                      true, settings);
         result->configuration = config_set;
     }
+    resolve_je_transitions(result);
 
-    cJSON_Delete(json);
-    wmem_map_insert(protocol_schema_je, java_version, result);
+    // The warm up thread frees its version names when it is done
+    wmem_map_insert(protocol_schema_je, wmem_strdup(get_schema_scope(), java_version), result);
     return result;
 }
 
-guint count_nbt_length_with_type(const guint8 *data, guint type) {
-    if (type == TAG_END)
-        return 0;
-    if (type == TAG_BYTE)
-        return 1;
-    if (type == TAG_SHORT)
-        return 2;
-    if (type == TAG_INT || type == TAG_FLOAT)
-        return 4;
-    if (type == TAG_LONG || type == TAG_DOUBLE)
-        return 8;
-    if (type == TAG_BYTE_ARRAY)
-        return 4 + ((((gint) data[0] & 0xff) << 24) | ((data[1] & 0xff) << 16) |
-                    ((data[2] & 0xff) << 8) | (data[3] & 0xff));
-    if (type == TAG_STRING)
-        return 2 + ((((gint) data[0] & 0xff) << 8) | (data[1] & 0xff));
-    if (type == TAG_LIST) {
-        guint sub_type = data[0];
-        if (sub_type == TAG_END)
-            return 5;
-        guint length = ((((gint) data[1] & 0xff) << 24) | ((data[2] & 0xff) << 16) |
-                        ((data[3] & 0xff) << 8) | (data[4] & 0xff));
-        guint sub_length = 0;
-        for (guint i = 0; i < length; i++)
-            sub_length += count_nbt_length_with_type(data + 5 + sub_length, sub_type);
-        return 5 + sub_length;
-    }
-    if (type == TAG_COMPOUND) {
-        guint sub_length = 0;
-        guint sub_type;
-        while ((sub_type = data[sub_length]) != TAG_END) {
-            gint name_length = ((((gint) data[sub_length + 1] & 0xff) << 8) | (data[sub_length + 2] & 0xff));
-            sub_length += 3 + name_length;
-            sub_length += count_nbt_length_with_type(data + sub_length, sub_type);
-        }
-        return sub_length + 1;
+protocol_je_set get_protocol_je_set(gchar *java_version) {
+    lock_schema();
+    protocol_je_set result = get_protocol_je_set_locked(java_version);
+    unlock_schema();
+    return result;
+}
+
+gpointer warm_up_je(gpointer data) {
+    gchar **versions = data;
+    for (gchar **version = versions; *version != NULL && !g_atomic_int_get(&warm_up_stop_je); version++) {
+        gint64 start = g_get_monotonic_time();
+        protocol_je_set set = get_protocol_je_set(*version);
+        if (set == NULL)
+            continue;
+        compile_protocol_set(set->login, &warm_up_stop_je);
+        compile_protocol_set(set->play, &warm_up_stop_je);
+        if (set->configuration != NULL)
+            compile_protocol_set(set->configuration, &warm_up_stop_je);
+        ws_debug("Warmed up protocol %s in %" G_GINT64_FORMAT " us", *version, g_get_monotonic_time() - start);
     }
-    if (type == TAG_INT_ARRAY)
-        return 4 + ((((gint) data[0] & 0xff) << 24) | ((data[1] & 0xff) << 16) |
-                    ((data[2] & 0xff) << 8) | (data[3] & 0xff)) * 4;
-    if (type == TAG_LONG_ARRAY)
-        return 4 + ((((gint) data[0] & 0xff) << 24) | ((data[1] & 0xff) << 16) |
-                    ((data[2] & 0xff) << 8) | (data[3] & 0xff)) * 8;
-    return 0;
+    g_strfreev(versions);
+    return NULL;
 }
 
-guint count_nbt_length(const guint8 *data) {
-    guint8 type = data[0];
-    gint skip = ((((gint) data[1] & 0xff) << 8) | (data[2] & 0xff));
-    guint length = count_nbt_length_with_type(data + 3 + skip, type);
-    return length + 3 + skip;
-}
\ No newline at end of file
+void stop_warm_up_je() {
+    if (warm_up_thread_je == NULL)
+        return;
+    g_atomic_int_set(&warm_up_stop_je, 1);
+    g_thread_join(warm_up_thread_je);
+    warm_up_thread_je = NULL;
+    g_atomic_int_set(&warm_up_stop_je, 0);
+}
+
+void start_warm_up_je(gchar *versions) {
+    stop_warm_up_je();
+    gchar *stripped = g_strstrip(g_strdup(versions));
+    gchar **list;
+    if (g_str_has_prefix(stripped, "latest")) {
+        guint count = (guint) g_ascii_strtoull(stripped + strlen("latest"), NULL, 10);
+        guint total = data_version_list_je->len;
+        count = MIN(MAX(count, 1), total);
+        list = g_new0(gchar *, count + 1);
+        for (guint i = 0; i < count; i++)
+            list[i] = g_strdup(get_java_version_name_by_data_version(
+                    g_array_index(data_version_list_je, guint, total - 1 - i)));
+    } else {
+        list = g_strsplit(stripped, ",", -1);
+        for (gchar **version = list; *version != NULL; version++)
+            g_strstrip(*version);
+    }
+    g_free(stripped);
+    if (list[0] == NULL || strlen(list[0]) == 0) {
+        g_strfreev(list);
+        return;
+    }
+    warm_up_thread_je = g_thread_new("mcje_warm_up", warm_up_je, list);
+}
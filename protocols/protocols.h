@@ -7,31 +7,35 @@
 
 #include <epan/proto.h>
 #include "protocol_schema.h"
-
-#define TAG_END        0
-#define TAG_BYTE       1
-#define TAG_SHORT      2
-#define TAG_INT        3
-#define TAG_LONG       4
-#define TAG_FLOAT      5
-#define TAG_DOUBLE     6
-#define TAG_BYTE_ARRAY 7
-#define TAG_STRING     8
-#define TAG_LIST       9
-#define TAG_COMPOUND   10
-#define TAG_INT_ARRAY  11
-#define TAG_LONG_ARRAY 12
+#include "nbt.h"
 
 extern GArray *data_version_list_je;
 
+typedef enum {
+    HANDSHAKE, PLAY, PING, LOGIN, CONFIGURATION, INVALID
+} je_state;
+
+// State change caused by a packet, the packet id is resolved when the set is built
+typedef struct {
+    gint packet_id; // -1 if no packet leaves the state
+    je_state next_state;
+    bool both_sides;
+} je_state_transition;
+
 typedef struct _protocol_je_set {
     protocol_set login;
     protocol_set play;
     protocol_set configuration;
+    je_state_transition transitions[INVALID][2]; // [state][is_client]
 } *protocol_je_set;
 
 void init_je();
 
+// Compiles the given versions in a background thread: "latest N" or a comma separated list, empty to do nothing
+void start_warm_up_je(gchar *versions);
+
+void stop_warm_up_je();
+
 gchar *get_java_version_name(guint protocol_version);
 
 gchar *get_java_version_name_unchecked(guint protocol_version);
@@ -44,8 +48,4 @@ guint find_nearest_java_protocol(guint data_version);
 
 protocol_je_set get_protocol_je_set(gchar *java_version);
 
-guint count_nbt_length_with_type(const guint8 *data, guint type);
-
-guint count_nbt_length(const guint8 *data);
-
 #endif //MC_DISSECTOR_PROTOCOLS_H
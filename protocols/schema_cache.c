@@ -0,0 +1,646 @@
+#include <string.h>
+#include <wsutil/filesystem.h>
+#include "schema_cache.h"
+#include "protocol_functions.h"
+#include "protocolSchemas.h"
+#include "strings_je.h"
+#include "buildId.h"
+#include "protocol_je/je_dissect.h"
+#include "protocol_be/be_dissect.h"
+#include "mc_dissector.h"
+
+#define CACHE_MAGIC 0x4353434D // "MCSC"
+#define CACHE_FORMAT 2
+#define CACHE_NONE 0xFFFFFFFF
+#define CACHE_DIRECTORY "mc_dissector_cache"
+
+typedef enum {
+    LAYOUT_LEAF,
+    LAYOUT_CONTAINER,
+    LAYOUT_OPTION,
+    LAYOUT_TOP_BIT_SET_TERMINATED_ARRAY,
+    LAYOUT_BUFFER,
+    LAYOUT_MAPPER,
+    LAYOUT_ARRAY,
+    LAYOUT_BITFIELD,
+    LAYOUT_SWITCH,
+    LAYOUT_ENTITY_METADATA_LOOP,
+    LAYOUT_BASIC_TYPE
+} cache_layout;
+
+typedef struct {
+    guint (*make_tree)(const guint8 *data, proto_tree *tree, tvbuff_t *tvb, extra_data *extra,
+                       protocol_field field, guint offset, guint remaining, data_recorder recorder);
+    cache_layout layout;
+} cache_kind;
+
+#define KIND(name, layout) {make_tree_##name, layout},
+
+// Kinds are saved as indexes of this table, the layout stamp in the key keeps them consistent
+const cache_kind CACHE_KINDS[] = {
+        KIND(var_int, LAYOUT_LEAF)
+        KIND(var_long, LAYOUT_LEAF)
+        KIND(string, LAYOUT_LEAF)
+        KIND(u8, LAYOUT_LEAF)
+        KIND(u16, LAYOUT_LEAF)
+        KIND(u32, LAYOUT_LEAF)
+        KIND(u64, LAYOUT_LEAF)
+        KIND(i8, LAYOUT_LEAF)
+        KIND(i16, LAYOUT_LEAF)
+        KIND(i32, LAYOUT_LEAF)
+        KIND(i64, LAYOUT_LEAF)
+        KIND(boolean, LAYOUT_LEAF)
+        KIND(f32, LAYOUT_LEAF)
+        KIND(f64, LAYOUT_LEAF)
+        KIND(uuid, LAYOUT_LEAF)
+        KIND(rest_buffer, LAYOUT_LEAF)
+        KIND(void, LAYOUT_LEAF)
+        KIND(nbt, LAYOUT_LEAF)
+        KIND(optional_nbt, LAYOUT_LEAF)
+        KIND(nbt_any_type, LAYOUT_LEAF)
+        KIND(var_buffer, LAYOUT_LEAF)
+        KIND(chunk_data, LAYOUT_LEAF)
+        KIND(unprefixed_chunk_data, LAYOUT_LEAF)
+        KIND(buffer, LAYOUT_BUFFER)
+        KIND(option, LAYOUT_OPTION)
+        KIND(mapper, LAYOUT_MAPPER)
+        KIND(bitfield, LAYOUT_BITFIELD)
+        KIND(switch, LAYOUT_SWITCH)
+        KIND(basic_type, LAYOUT_BASIC_TYPE)
+        KIND(je_container, LAYOUT_CONTAINER)
+        KIND(be_container, LAYOUT_CONTAINER)
+        KIND(je_array, LAYOUT_ARRAY)
+        KIND(be_array, LAYOUT_ARRAY)
+        KIND(je_top_bit_set_terminated_array, LAYOUT_TOP_BIT_SET_TERMINATED_ARRAY)
+        KIND(be_top_bit_set_terminated_array, LAYOUT_TOP_BIT_SET_TERMINATED_ARRAY)
+        KIND(je_entity_metadata_loop, LAYOUT_ENTITY_METADATA_LOOP)
+        KIND(be_entity_metadata_loop, LAYOUT_ENTITY_METADATA_LOOP)
+#ifdef MC_DISSECTOR_FUNCTION_FEATURE
+        KIND(record_entity_id, LAYOUT_LEAF)
+        KIND(record_entity_id_player, LAYOUT_LEAF)
+        KIND(record_entity_id_experience_orb, LAYOUT_LEAF)
+        KIND(record_entity_id_painting, LAYOUT_LEAF)
+        KIND(sync_entity_data, LAYOUT_LEAF)
+#endif // MC_DISSECTOR_FUNCTION_FEATURE
+};
+
+#define KIND_COUNT (sizeof(CACHE_KINDS) / sizeof(cache_kind))
+
+// File layout: header, string table padded to 4 bytes, fields, entries, then the data words of fields
+typedef struct {
+    guint32 magic;
+    guint32 format;
+    guint32 key;
+    guint32 string_size;
+    guint32 field_count;
+    guint32 entry_count;
+    guint32 data_size;
+} cache_header;
+
+typedef struct {
+    guint32 kind;
+    guint32 name;
+    guint32 display_name;
+    guint32 hf;          // abbreviation of the hf, CACHE_NONE to use hf_raw
+    gint32 hf_raw;
+    guint32 hf_resolved;
+    guint32 data;        // index of the first data word
+} cache_field;
+
+typedef struct {
+    guint32 is_client;
+    guint32 packet_id;
+    guint32 field;
+} cache_entry;
+
+// Only the same sources built with the same options give the same key. The build id is a hash of the sources, the
+// kinds and the size of fields change with the options
+gchar *get_cache_key() {
+    guint32 layout = (guint32) sizeof(protocol_field_t) * 31 + (guint32) KIND_COUNT;
+    return g_strdup_printf("%s/%s/%s/%s/%08x/%d", MC_DISSECTOR_VERSION, BUILD_ID, SCHEMA_HASH, HF_HASH_je, layout,
+                           CACHE_FORMAT);
+}
+
+gchar *get_cache_path(const gchar *name, bool create) {
+    gchar *directory = get_persconffile_path(CACHE_DIRECTORY, TRUE);
+    if (create)
+        g_mkdir_with_parents(directory, 0755);
+    gchar *file_name = g_strconcat(name, ".bin", NULL);
+    g_strdelimit(file_name, "/\\", '_');
+    gchar *path = g_build_filename(directory, file_name, NULL);
+    g_free(directory);
+    g_free(file_name);
+    return path;
+}
+
+// ---------------------------------- Writer ----------------------------------
+
+struct _schema_cache_writer {
+    wmem_allocator_t *allocator;
+    wmem_map_t *field_ids;      // field -> id + 1
+    wmem_map_t *string_offsets; // string -> offset + 1
+    GPtrArray *fields;
+    GString *strings;
+    GArray *entries;
+    GArray *data;
+};
+
+schema_cache_writer schema_cache_writer_new() {
+    wmem_allocator_t *allocator = wmem_allocator_new(WMEM_ALLOCATOR_SIMPLE);
+    schema_cache_writer writer = wmem_new(allocator, schema_cache_writer_t);
+    writer->allocator = allocator;
+    writer->field_ids = wmem_map_new(allocator, g_direct_hash, g_direct_equal);
+    writer->string_offsets = wmem_map_new(allocator, g_str_hash, g_str_equal);
+    writer->fields = g_ptr_array_new();
+    writer->strings = g_string_new(NULL);
+    writer->entries = g_array_new(false, false, sizeof(cache_entry));
+    writer->data = g_array_new(false, false, sizeof(guint32));
+    return writer;
+}
+
+void schema_cache_writer_free(schema_cache_writer writer) {
+    g_ptr_array_free(writer->fields, true);
+    g_string_free(writer->strings, true);
+    g_array_free(writer->entries, true);
+    g_array_free(writer->data, true);
+    wmem_destroy_allocator(writer->allocator);
+}
+
+guint32 write_string(schema_cache_writer writer, const gchar *str) {
+    if (str == NULL)
+        return CACHE_NONE;
+    guint32 offset = GPOINTER_TO_UINT(wmem_map_lookup(writer->string_offsets, str));
+    if (offset != 0)
+        return offset - 1;
+    offset = writer->strings->len;
+    g_string_append(writer->strings, str);
+    g_string_append_c(writer->strings, '\0');
+    wmem_map_insert(writer->string_offsets, wmem_strdup(writer->allocator, str), GUINT_TO_POINTER(offset + 1));
+    return offset;
+}
+
+gint find_kind(protocol_field field) {
+    for (guint i = 0; i < KIND_COUNT; i++)
+        if (CACHE_KINDS[i].make_tree == field->make_tree)
+            return (gint) i;
+    return -1;
+}
+
+guint32 field_id(schema_cache_writer writer, protocol_field field) {
+    return field == NULL ? CACHE_NONE : GPOINTER_TO_UINT(wmem_map_lookup(writer->field_ids, field)) - 1;
+}
+
+bool add_field(schema_cache_writer writer, protocol_field field) {
+    if (field == NULL || wmem_map_contains(writer->field_ids, field))
+        return true;
+    gint kind = find_kind(field);
+    if (kind == -1)
+        return false;
+    g_ptr_array_add(writer->fields, field);
+    wmem_map_insert(writer->field_ids, field, GUINT_TO_POINTER(writer->fields->len));
+    switch (CACHE_KINDS[kind].layout) {
+        case LAYOUT_CONTAINER:
+            for (guint i = 0; i < field->container.size; i++)
+                if (!add_field(writer, field->container.children[i]))
+                    return false;
+            return true;
+        case LAYOUT_OPTION:
+            return add_field(writer, field->option.sub_field);
+        case LAYOUT_TOP_BIT_SET_TERMINATED_ARRAY:
+            return add_field(writer, field->top_bit_set_terminated_array.sub_field);
+        case LAYOUT_MAPPER:
+            return add_field(writer, field->mapper.sub_field);
+        case LAYOUT_ARRAY:
+            return add_field(writer, field->array.sub_field);
+        case LAYOUT_SWITCH:
+            if (!add_field(writer, field->switch_.default_field))
+                return false;
+            for (guint i = 0; i < field->switch_.size; i++)
+                if (!add_field(writer, field->switch_.cases[i].value))
+                    return false;
+            return true;
+        case LAYOUT_ENTITY_METADATA_LOOP:
+            return add_field(writer, field->entity_metadata_loop.sub_field);
+        case LAYOUT_BASIC_TYPE:
+            return add_field(writer, field->basic_type.sub_field);
+        default:
+            return true;
+    }
+}
+
+bool schema_cache_writer_add(schema_cache_writer writer, bool is_client, guint packet_id, protocol_field field) {
+    if (!add_field(writer, field))
+        return false;
+    cache_entry entry = {is_client, packet_id, field_id(writer, field)};
+    g_array_append_val(writer->entries, entry);
+    return true;
+}
+
+#define WRITE_WORD(value) { guint32 word = (guint32) (value); g_array_append_val(writer->data, word); }
+
+void write_string_list(schema_cache_writer writer, gchar **list) {
+    guint count = list == NULL ? 0 : g_strv_length(list);
+    WRITE_WORD(count)
+    for (guint i = 0; i < count; i++)
+        WRITE_WORD(write_string(writer, list[i]))
+}
+
+guint32 write_field_data(schema_cache_writer writer, protocol_field field, cache_layout layout) {
+    guint32 start = writer->data->len;
+    switch (layout) {
+        case LAYOUT_LEAF:
+            return CACHE_NONE;
+        case LAYOUT_CONTAINER:
+            WRITE_WORD(field->container.size)
+            WRITE_WORD(field->container.on_top)
+            for (guint i = 0; i < field->container.size; i++)
+                WRITE_WORD(field_id(writer, field->container.children[i]))
+            break;
+        case LAYOUT_OPTION:
+            WRITE_WORD(field_id(writer, field->option.sub_field))
+            break;
+        case LAYOUT_TOP_BIT_SET_TERMINATED_ARRAY:
+            WRITE_WORD(field_id(writer, field->top_bit_set_terminated_array.sub_field))
+            break;
+        case LAYOUT_BUFFER:
+            WRITE_WORD(field->buffer.length)
+            break;
+        case LAYOUT_MAPPER:
+            WRITE_WORD(field_id(writer, field->mapper.sub_field))
+            WRITE_WORD(field->mapper.size)
+            for (guint i = 0; i < field->mapper.size; i++) {
+                WRITE_WORD(write_string(writer, field->mapper.mappings[i].key))
+                WRITE_WORD(write_string(writer, field->mapper.mappings[i].value))
+            }
+            break;
+        case LAYOUT_ARRAY:
+            WRITE_WORD(field_id(writer, field->array.sub_field))
+            write_string_list(writer, field->array.count_path == NULL ? NULL : field->array.count_path->source);
+            break;
+        case LAYOUT_BITFIELD: {
+            // Same key as the bitmask hf lookup when compiling
+            gchar *bitmask_name = g_strdup("");
+            for (guint i = 0; i < field->bitfield.size; i++) {
+                gchar *next = g_strdup_printf("%s[%d]%s", bitmask_name, field->bitfield.bits[i],
+                                              field->bitfield.names[i]);
+                g_free(bitmask_name);
+                bitmask_name = next;
+            }
+            WRITE_WORD(field->bitfield.size)
+            WRITE_WORD(field->bitfield.total_bytes)
+            WRITE_WORD(write_string(writer, bitmask_name))
+            g_free(bitmask_name);
+            for (guint i = 0; i < field->bitfield.size; i++) {
+                WRITE_WORD(field->bitfield.bits[i])
+                WRITE_WORD(field->bitfield.signed_[i])
+                WRITE_WORD(write_string(writer, field->bitfield.names[i]))
+            }
+            break;
+        }
+        case LAYOUT_SWITCH:
+            write_string_list(writer, field->switch_.path->source);
+            WRITE_WORD(field_id(writer, field->switch_.default_field))
+            WRITE_WORD(field->switch_.size)
+            for (guint i = 0; i < field->switch_.size; i++) {
+                WRITE_WORD(write_string(writer, field->switch_.cases[i].key))
+                WRITE_WORD(field_id(writer, field->switch_.cases[i].value))
+            }
+            break;
+        case LAYOUT_ENTITY_METADATA_LOOP:
+            WRITE_WORD(field_id(writer, field->entity_metadata_loop.sub_field))
+            WRITE_WORD(field->entity_metadata_loop.end_val)
+            break;
+        case LAYOUT_BASIC_TYPE:
+            WRITE_WORD(field_id(writer, field->basic_type.sub_field))
+            WRITE_WORD(field->basic_type.size)
+            for (guint i = 0; i < field->basic_type.size; i++) {
+                WRITE_WORD(write_string(writer, field->basic_type.names[i]))
+                WRITE_WORD(write_string(writer, field->basic_type.aliases[i]))
+            }
+            break;
+    }
+    return start;
+}
+
+bool schema_cache_writer_save(schema_cache_writer writer, const gchar *name) {
+    guint field_count = writer->fields->len;
+    cache_field *fields = g_new(cache_field, field_count);
+    for (guint i = 0; i < field_count; i++) {
+        protocol_field field = g_ptr_array_index(writer->fields, i);
+        gint kind = find_kind(field);
+        const gchar *abbrev = field->hf_index > 0 ? proto_registrar_get_abbrev(field->hf_index) : NULL;
+        fields[i].kind = kind;
+        fields[i].name = write_string(writer, field->name);
+        fields[i].display_name = write_string(writer, field->display_name);
+        fields[i].hf = write_string(writer, abbrev);
+        fields[i].hf_raw = abbrev == NULL ? field->hf_index : -1;
+        fields[i].hf_resolved = field->hf_resolved;
+        fields[i].data = write_field_data(writer, field, CACHE_KINDS[kind].layout);
+    }
+
+    gchar *key = get_cache_key();
+    cache_header header = {CACHE_MAGIC, CACHE_FORMAT, write_string(writer, key), 0, field_count,
+                           writer->entries->len, writer->data->len};
+    g_free(key);
+    while (writer->strings->len % 4 != 0)
+        g_string_append_c(writer->strings, '\0');
+    header.string_size = writer->strings->len;
+
+    gsize size = sizeof(cache_header) + header.string_size + field_count * sizeof(cache_field) +
+                 header.entry_count * sizeof(cache_entry) + header.data_size * sizeof(guint32);
+    guint8 *buffer = g_malloc(size);
+    guint8 *now = buffer;
+#define APPEND(source, length) memcpy(now, source, length); now += (length);
+    APPEND(&header, sizeof(cache_header))
+    APPEND(writer->strings->str, header.string_size)
+    APPEND(fields, field_count * sizeof(cache_field))
+    APPEND(writer->entries->data, header.entry_count * sizeof(cache_entry))
+    APPEND(writer->data->data, header.data_size * sizeof(guint32))
+#undef APPEND
+
+    gchar *path = get_cache_path(name, true);
+    bool success = g_file_set_contents(path, (const gchar *) buffer, (gssize) size, NULL);
+    WS_LOG("Saved schema cache %s: %u fields, %lu bytes, %s", path, field_count, (unsigned long) size,
+           success ? "ok" : "failed");
+    g_free(path);
+    g_free(buffer);
+    g_free(fields);
+    schema_cache_writer_free(writer);
+    return success;
+}
+
+// ---------------------------------- Loader ----------------------------------
+
+typedef struct {
+    const gchar *strings;
+    guint32 string_size;
+    const cache_field *fields;
+    guint32 field_count;
+    const guint32 *data;
+    guint32 data_size;
+    guint32 cursor;
+    bool failed;
+    bool is_je;
+    protocol_field *built;
+} cache_reader;
+
+guint32 read_word(cache_reader *reader) {
+    if (reader->cursor >= reader->data_size) {
+        reader->failed = true;
+        return 0;
+    }
+    return reader->data[reader->cursor++];
+}
+
+gchar *read_string_at(cache_reader *reader, guint32 offset) {
+    if (offset == CACHE_NONE)
+        return NULL;
+    if (offset >= reader->string_size) {
+        reader->failed = true;
+        return NULL;
+    }
+    return (gchar *) reader->strings + offset;
+}
+
+gchar *read_string(cache_reader *reader) {
+    return read_string_at(reader, read_word(reader));
+}
+
+// Only the default of a switch may be missing, every other sub field is there in a compiled schema
+protocol_field read_field(cache_reader *reader, bool required) {
+    guint32 id = read_word(reader);
+    if (id == CACHE_NONE) {
+        if (required)
+            reader->failed = true;
+        return NULL;
+    }
+    if (id >= reader->field_count) {
+        reader->failed = true;
+        return NULL;
+    }
+    return reader->built[id];
+}
+
+// Every count is checked against the remaining words before anything is allocated
+guint32 read_count(cache_reader *reader, guint32 words_per_item) {
+    guint32 count = read_word(reader);
+    if ((guint64) count * words_per_item > reader->data_size - reader->cursor) {
+        reader->failed = true;
+        return 0;
+    }
+    return count;
+}
+
+record_slot read_slot(cache_reader *reader, const gchar *name) {
+    if (name == NULL) {
+        reader->failed = true;
+        return RECORD_SLOT_NONE;
+    }
+    return record_intern(name);
+}
+
+gchar **read_string_list(cache_reader *reader) {
+    guint32 count = read_count(reader, 1);
+    if (count == 0)
+        return NULL;
+    gchar **list = wmem_alloc_array(get_schema_scope(), gchar *, count + 1);
+    for (guint32 i = 0; i < count; i++)
+        list[i] = read_string(reader);
+    list[count] = NULL;
+    return list;
+}
+
+record_path read_path(cache_reader *reader) {
+    gchar **source = read_string_list(reader);
+    return source == NULL || reader->failed ? NULL : record_compile_path(get_schema_scope(), source);
+}
+
+void read_field_data(cache_reader *reader, protocol_field field, cache_layout layout) {
+    wmem_allocator_t *scope = get_schema_scope();
+    switch (layout) {
+        case LAYOUT_LEAF:
+            return;
+        case LAYOUT_CONTAINER:
+            field->container.size = read_count(reader, 1);
+            field->container.on_top = read_word(reader);
+            field->container.children = wmem_alloc_array(scope, protocol_field, field->container.size);
+            for (guint i = 0; i < field->container.size; i++)
+                field->container.children[i] = read_field(reader, true);
+            return;
+        case LAYOUT_OPTION:
+            field->option.sub_field = read_field(reader, true);
+            return;
+        case LAYOUT_TOP_BIT_SET_TERMINATED_ARRAY:
+            field->top_bit_set_terminated_array.sub_field = read_field(reader, true);
+            return;
+        case LAYOUT_BUFFER:
+            field->buffer.length = read_word(reader);
+            return;
+        case LAYOUT_MAPPER:
+            field->mapper.sub_field = read_field(reader, true);
+            field->mapper.size = read_count(reader, 2);
+            field->mapper.mappings = wmem_alloc_array(scope, protocol_case, field->mapper.size);
+            for (guint i = 0; i < field->mapper.size; i++) {
+                field->mapper.mappings[i].key = read_string(reader);
+                field->mapper.mappings[i].value = read_string(reader);
+            }
+            if (!reader->failed)
+                build_int_cases(&field->mapper.int_mappings, field->mapper.mappings, field->mapper.size);
+            return;
+        case LAYOUT_ARRAY:
+            field->array.sub_field = read_field(reader, true);
+            field->array.count_path = read_path(reader);
+            return;
+        case LAYOUT_BITFIELD: {
+            guint size = read_word(reader);
+            field->bitfield.total_bytes = read_word(reader);
+            gchar *bitmask_name = read_string(reader);
+            if ((guint64) size * 3 > reader->data_size - reader->cursor) {
+                reader->failed = true;
+                size = 0;
+            }
+            field->bitfield.size = size;
+            field->bitfield.bits = wmem_alloc_array(scope, guint8, size);
+            field->bitfield.signed_ = wmem_alloc_array(scope, bool, size);
+            field->bitfield.names = wmem_alloc_array(scope, gchar *, size);
+            field->bitfield.slots = wmem_alloc_array(scope, record_slot, size);
+            for (guint i = 0; i < size; i++) {
+                field->bitfield.bits[i] = read_word(reader);
+                field->bitfield.signed_[i] = read_word(reader);
+                field->bitfield.names[i] = read_string(reader);
+                field->bitfield.slots[i] = read_slot(reader, field->bitfield.names[i]);
+            }
+            field->bitfield.hf_indexes = bitmask_name == NULL ? NULL : wmem_map_lookup(
+                    reader->is_je ? bitmask_hf_map_je : bitmask_hf_map_be, bitmask_name);
+            if (field->bitfield.hf_indexes == NULL)
+                reader->failed = true;
+            return;
+        }
+        case LAYOUT_SWITCH:
+            field->switch_.path = read_path(reader);
+            field->switch_.default_field = read_field(reader, false);
+            field->switch_.size = read_count(reader, 2);
+            field->switch_.cases = wmem_alloc_array(scope, protocol_case, field->switch_.size);
+            for (guint i = 0; i < field->switch_.size; i++) {
+                field->switch_.cases[i].key = read_string(reader);
+                field->switch_.cases[i].value = read_field(reader, true);
+            }
+            if (field->switch_.path == NULL)
+                reader->failed = true;
+            if (!reader->failed)
+                build_int_cases(&field->switch_.int_cases, field->switch_.cases, field->switch_.size);
+            return;
+        case LAYOUT_ENTITY_METADATA_LOOP:
+            field->entity_metadata_loop.sub_field = read_field(reader, true);
+            field->entity_metadata_loop.end_val = read_word(reader);
+            return;
+        case LAYOUT_BASIC_TYPE:
+            field->basic_type.sub_field = read_field(reader, true);
+            field->basic_type.size = read_count(reader, 2);
+            field->basic_type.names = wmem_alloc_array(scope, gchar *, field->basic_type.size);
+            field->basic_type.aliases = wmem_alloc_array(scope, gchar *, field->basic_type.size);
+            field->basic_type.name_slots = wmem_alloc_array(scope, record_slot, field->basic_type.size);
+            field->basic_type.alias_slots = wmem_alloc_array(scope, record_slot, field->basic_type.size);
+            for (guint i = 0; i < field->basic_type.size; i++) {
+                field->basic_type.names[i] = read_string(reader);
+                field->basic_type.aliases[i] = read_string(reader);
+                field->basic_type.name_slots[i] = read_slot(reader, field->basic_type.names[i]);
+                field->basic_type.alias_slots[i] = read_slot(reader, field->basic_type.aliases[i]);
+                record_use(field->basic_type.alias_slots[i]);
+            }
+            return;
+    }
+}
+
+bool read_cache(cache_reader *reader, const gchar *contents, gsize size, const cache_entry **entries,
+                guint32 *entry_count) {
+    if (size < sizeof(cache_header))
+        return false;
+    const cache_header *header = (const cache_header *) contents;
+    if (header->magic != CACHE_MAGIC || header->format != CACHE_FORMAT || header->string_size % 4 != 0)
+        return false;
+    guint64 expected = sizeof(cache_header) + (guint64) header->string_size +
+                       (guint64) header->field_count * sizeof(cache_field) +
+                       (guint64) header->entry_count * sizeof(cache_entry) +
+                       (guint64) header->data_size * sizeof(guint32);
+    if (expected != size || header->string_size == 0)
+        return false;
+
+    reader->strings = contents + sizeof(cache_header);
+    reader->string_size = header->string_size;
+    reader->fields = (const cache_field *) (reader->strings + header->string_size);
+    reader->field_count = header->field_count;
+    *entries = (const cache_entry *) (reader->fields + header->field_count);
+    *entry_count = header->entry_count;
+    reader->data = (const guint32 *) (*entries + header->entry_count);
+    reader->data_size = header->data_size;
+    if (reader->strings[reader->string_size - 1] != '\0')
+        return false;
+
+    gchar *key = get_cache_key();
+    gchar *saved_key = read_string_at(reader, header->key);
+    bool matched = saved_key != NULL && strcmp(key, saved_key) == 0;
+    g_free(key);
+    if (!matched)
+        return false;
+
+    // Allocate first so fields can refer to the ones after them
+    reader->built = wmem_alloc_array(get_schema_scope(), protocol_field, reader->field_count);
+    for (guint32 i = 0; i < reader->field_count; i++)
+        reader->built[i] = wmem_new0(get_schema_scope(), protocol_field_t);
+    for (guint32 i = 0; i < reader->field_count && !reader->failed; i++) {
+        const cache_field *saved = reader->fields + i;
+        if (saved->kind >= KIND_COUNT)
+            return false;
+        protocol_field field = reader->built[i];
+        field->make_tree = CACHE_KINDS[saved->kind].make_tree;
+        field->name = read_string_at(reader, saved->name);
+        field->slot = field->name == NULL ? RECORD_SLOT_NONE : record_intern(field->name);
+        field->display_name = read_string_at(reader, saved->display_name);
+        field->hf_resolved = saved->hf_resolved;
+        if (saved->hf != CACHE_NONE) {
+            gchar *abbrev = read_string_at(reader, saved->hf);
+            field->hf_index = abbrev == NULL ? -1 : proto_registrar_get_id_byname(abbrev);
+            if (field->hf_index == -1)
+                return false;
+        } else
+            field->hf_index = saved->hf_raw;
+        reader->cursor = saved->data == CACHE_NONE ? reader->data_size : saved->data;
+        read_field_data(reader, field, CACHE_KINDS[saved->kind].layout);
+    }
+    // Widths come from the sub fields, which may be built after their arrays
+    for (guint32 i = 0; i < reader->field_count && !reader->failed; i++)
+        if (CACHE_KINDS[reader->fields[i].kind].layout == LAYOUT_ARRAY && reader->built[i]->array.sub_field != NULL)
+            reader->built[i]->array.element_width = get_fixed_width(reader->built[i]->array.sub_field);
+    for (guint32 i = 0; i < *entry_count; i++)
+        if ((*entries)[i].field != CACHE_NONE && (*entries)[i].field >= reader->field_count)
+            return false;
+    return !reader->failed;
+}
+
+bool load_schema_cache(const gchar *name, bool is_je, schema_cache_callback callback, gpointer user_data) {
+    gchar *path = get_cache_path(name, false);
+    GMappedFile *file = g_mapped_file_new(path, false, NULL);
+    if (file == NULL) {
+        g_free(path);
+        return false;
+    }
+    cache_reader reader = {0};
+    reader.is_je = is_je;
+    const cache_entry *entries = NULL;
+    guint32 entry_count = 0;
+    bool success = read_cache(&reader, g_mapped_file_get_contents(file), g_mapped_file_get_length(file),
+                              &entries, &entry_count);
+    WS_LOG("Loaded schema cache %s: %s", path, success ? "ok" : "ignored");
+    g_free(path);
+    if (!success) {
+        // Fields already built stay unused in the schema scope
+        g_mapped_file_unref(file);
+        return false;
+    }
+    for (guint32 i = 0; i < entry_count; i++)
+        callback(entries[i].is_client, entries[i].packet_id,
+                 entries[i].field == CACHE_NONE ? NULL : reader.built[entries[i].field], user_data);
+    // Strings of the loaded fields live in the mapping
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef MC_DISSECTOR_SCHEMA_CACHE_H
+#define MC_DISSECTOR_SCHEMA_CACHE_H
+
+#include "protocol_schema.h"
+
+// Compiled protocol sets saved in the personal configuration of the profile, one file per set.
+// A file is only used by the build that wrote it and with the same embedded schema. Fields are rebuilt from the
+// mapped file, whose strings are used in place, so the mapping is kept for the lifetime of the plugin.
+
+typedef struct _schema_cache_writer schema_cache_writer_t, *schema_cache_writer;
+
+typedef void (*schema_cache_callback)(bool is_client, guint packet_id, protocol_field field, gpointer user_data);
+
+schema_cache_writer schema_cache_writer_new();
+
+// Returns false if the field uses something that can not be saved
+bool schema_cache_writer_add(schema_cache_writer writer, bool is_client, guint packet_id, protocol_field field);
+
+// Writes the cache of the named set and frees the writer
+bool schema_cache_writer_save(schema_cache_writer writer, const gchar *name);
+
+void schema_cache_writer_free(schema_cache_writer writer);
+
+// Calls the callback for every saved packet, nothing is called if the cache is missing, stale or broken
+bool load_schema_cache(const gchar *name, bool is_je, schema_cache_callback callback, gpointer user_data);
+
+#endif //MC_DISSECTOR_SCHEMA_CACHE_H